@@ -1,10 +1,9 @@
 #include "compilium.h"
 
-static int reg_used_table[NUM_OF_SCRATCH_REGS];
-static struct Node *reg_node_table[NUM_OF_SCRATCH_REGS];
-
 static void AllocReg(struct Node *n) {
   assert(n);
+  int *reg_used_table = compilation->reg_used_table;
+  struct Node **reg_node_table = compilation->reg_node_table;
   for (int i = 1; i <= NUM_OF_SCRATCH_REGS; i++) {
     if (!reg_used_table[i]) {
       reg_used_table[i] = 1;
@@ -29,8 +28,8 @@ static void AllocReg(struct Node *n) {
 
 static void FreeReg(int reg) {
   assert(1 <= reg && reg <= NUM_OF_SCRATCH_REGS);
-  reg_used_table[reg] = 0;
-  reg_node_table[reg] = NULL;
+  compilation->reg_used_table[reg] = 0;
+  compilation->reg_node_table[reg] = NULL;
 }
 
 static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
@@ -55,14 +54,14 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
     }
     return;
   } else if (node->type == kASTFuncDef) {
-    AddFuncDef(ctx, CreateTokenStr(node->func_name_token), node);
+    AddFuncDef(ctx, node->func_name_token, node);
     struct SymbolEntry *saved_ctx = *ctx;
     struct Node *arg_type_list = GetArgTypeList(node->func_type);
     assert(arg_type_list);
     node->arg_var_list = AllocList();
     for (int i = 0; i < GetSizeOfList(arg_type_list); i++) {
       struct Node *arg_type_with_attr = GetNodeAt(arg_type_list, i);
-      struct Node *arg_ident_token =
+      struct Token *arg_ident_token =
           GetIdentifierTokenFromTypeAttr(arg_type_with_attr);
       if (!arg_ident_token) {
         PushToList(node->arg_var_list, NULL);
@@ -71,7 +70,7 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
       struct Node *arg_type = GetTypeWithoutAttr(arg_type_with_attr);
       assert(arg_type);
       struct Node *local_var =
-          AddLocalVar(ctx, CreateTokenStr(arg_ident_token), arg_type);
+          AddLocalVar(ctx, arg_ident_token, arg_type);
       PushToList(node->arg_var_list, local_var);
     }
     AnalyzeNode(node->func_body, ctx);
@@ -100,21 +99,20 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
       AnalyzeNode(node->right, ctx);
       node->reg = node->left->reg;
       FreeReg(node->right->reg);
-      node->expr_type = CreateTypeLValue(
-          GetTypeWithoutAttr(node->left->expr_type)->type_array_type_of);
+      struct Node *left_type = GetTypeWithoutAttr(node->left->expr_type);
+      assert(left_type->type == kTypeArray);
+      node->expr_type = CreateTypeLValue(left_type->type_array_type_of);
       return;
     } else if (IsEqualTokenWithCStr(node->op, ".") ||
                IsEqualTokenWithCStr(node->op, "->")) {
       AnalyzeNode(node->left, ctx);
       node->reg = node->left->reg;
-      PrintASTNode(node->left->expr_type);
-      assert(node->right && node->right->type == kNodeToken);
+      assert(node->right && node->right->type == kASTIdent);
       if (IsEqualTokenWithCStr(node->op, ".")) {
         if (GetTypeWithoutAttr(node->left->expr_type)->type != kTypeStruct)
           ErrorWithToken(node->op, "left operand is not a struct");
         struct Node *member =
-            FindStructMember(node->left->expr_type, node->right);
-        PrintASTNode(member);
+            FindStructMember(node->left->expr_type, node->right->op);
         node->byte_offset = member->struct_member_ent_ofs;
         node->expr_type = CreateTypeLValue(
             GetTypeWithoutAttr(member->struct_member_ent_type));
@@ -122,12 +120,11 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
       }
       if (IsEqualTokenWithCStr(node->op, "->")) {
         struct Node *left_type = GetTypeWithoutAttr(node->left->expr_type);
-        PrintASTNode(left_type);
         assert(left_type->type == kTypePointer);
         struct Node *left_deref_type = left_type->right;
         assert(left_deref_type->type == kTypeStruct);
-        struct Node *member = FindStructMember(left_deref_type, node->right);
-        PrintASTNode(member);
+        struct Node *member =
+            FindStructMember(left_deref_type, node->right->op);
         node->byte_offset = member->struct_member_ent_ofs;
         node->expr_type = CreateTypeLValue(
             GetTypeWithoutAttr(member->struct_member_ent_type));
@@ -232,29 +229,25 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
     *ctx = saved_ctx;
     return;
   } else if (node->type == kASTDecl) {
-    struct Node *raw_type = CreateTypeInContext(*ctx, node->op, node->right);
-    PrintASTNode(raw_type);
+    struct Node *raw_type = CreateTypeInContext(*ctx, node->left, node->right);
     assert(raw_type);
-    struct Node *type_ident = NULL;
-    if (raw_type && raw_type->type == kTypeAttrIdent) {
-      type_ident = raw_type->left;
-    }
+    struct Token *type_ident = GetIdentifierTokenFromTypeAttr(raw_type);
     struct Node *type = GetTypeWithoutAttr(raw_type);
     assert(type);
 
     if (type_ident && type->type == kTypeFunction) {
-      AddFuncDeclType(ctx, CreateTokenStr(type_ident), raw_type);
+      AddFuncDeclType(ctx, type_ident, raw_type);
       return;
     }
     if (!type_ident && type->type == kTypeStruct) {
       struct Node *spec = type->type_struct_spec;
       ResolveTypesOfMembersOfStruct(*ctx, spec);
       assert(type->tag);
-      AddStructType(ctx, CreateTokenStr(type->tag), type);
+      AddStructType(ctx, type->tag, type);
       return;
     }
     assert(type && type_ident);
-    AddLocalVar(ctx, CreateTokenStr(type_ident), type);
+    AddLocalVar(ctx, type_ident, type);
     assert(node->right->type == kASTDecltor);
     if (node->right->decltor_init_expr) {
       struct Node *left_expr = AllocNode(kASTExpr);
@@ -299,7 +292,12 @@ static void AnalyzeNode(struct Node *node, struct SymbolEntry **ctx) {
   ErrorWithToken(node->op, "AnalyzeNode: Not implemented");
 }
 
-void Analyze(struct Node *ast) {
-  struct SymbolEntry *root_ctx = NULL;
-  AnalyzeNode(ast, &root_ctx);
+struct SymbolEntry *Analyze(struct Node *ast) {
+  // returns the symbols declared at the top level, on top of the prelude.
+  assert(ast && ast->type == kASTList);
+  struct SymbolEntry *root_ctx = compilation->prelude_symbols;
+  for (int i = 0; i < GetSizeOfList(ast); i++) {
+    AnalyzeNode(GetNodeAt(ast, i), &root_ctx);
+  }
+  return root_ctx;
 }
@@ -0,0 +1,76 @@
+#include "compilium.h"
+
+// Objects which live as long as a compilation, such as tokens, nodes and
+// symbols, are allocated from the arena of the compilation by bumping a
+// pointer in large chunks. Nothing is freed one by one. ResetArena rewinds the
+// whole arena at once, and its chunks are then reused from the first one.
+
+#define ARENA_CHUNK_SIZE (1024 * 1024)
+// Nothing allocated from arenas needs more than the alignment of pointers.
+#define ARENA_ALIGNMENT 8
+
+struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t capacity;
+  size_t used;
+};
+
+#define ARENA_CHUNK_HEADER_SIZE \
+  ((sizeof(struct ArenaChunk) + ARENA_ALIGNMENT - 1) & \
+   ~(size_t)(ARENA_ALIGNMENT - 1))
+
+static char *GetArenaChunkData(struct ArenaChunk *c) {
+  return (char *)c + ARENA_CHUNK_HEADER_SIZE;
+}
+
+static struct ArenaChunk *GetArenaChunkWithRoom(struct Arena *a, size_t size) {
+  // moves to the next chunk which has room for size, allocating it if needed.
+  // Chunks after the current one are left from before the last reset.
+  struct ArenaChunk **next = a->current ? &a->current->next : &a->chunks;
+  if (!*next || (*next)->capacity < size) {
+    size_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+    struct ArenaChunk *c = malloc(ARENA_CHUNK_HEADER_SIZE + capacity);
+    assert(c);
+    c->capacity = capacity;
+    c->next = *next;
+    *next = c;
+  }
+  (*next)->used = 0;
+  return a->current = *next;
+}
+
+void *AllocFromArena(size_t size) {
+  // returns zero-filled memory which lives until the arena is reset.
+  struct Arena *a = &compilation->arena;
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+  struct ArenaChunk *c = a->current;
+  if (!c || c->capacity - c->used < size) c = GetArenaChunkWithRoom(a, size);
+  char *p = GetArenaChunkData(c) + c->used;
+  c->used += size;
+  memset(p, 0, size);
+  return p;
+}
+
+char *CopyStrToArena(const char *s, int length) {
+  // returns a NUL-terminated copy of s[0..length).
+  char *copied = AllocFromArena(length + 1);
+  if (compilation->mem_report) CountMemReportAlloc(kMemSiteCopyStr, length + 1);
+  memcpy(copied, s, length);
+  return copied;
+}
+
+void GetArenaUsage(struct Arena *a, size_t *used, size_t *reserved) {
+  // used is the size allocated since the last reset, including padding.
+  *used = *reserved = 0;
+  bool is_used = a->current != NULL;
+  for (struct ArenaChunk *c = a->chunks; c; c = c->next) {
+    if (is_used) *used += c->used;
+    *reserved += c->capacity;
+    if (c == a->current) is_used = false;
+  }
+}
+
+void ResetArena(struct Arena *a) {
+  // Memory allocated from a should not be used after this.
+  a->current = NULL;
+}
@@ -1,12 +1,119 @@
 #include "compilium.h"
 
+// Nodes allocated by each compilation are counted by type for --node-stats.
+struct NodeStats {
+  long num_of_nodes[kNumOfNodeTypes];
+  long bytes[kNumOfNodeTypes];
+};
+
+static const char *node_type_names[kNumOfNodeTypes] = {
+    [kNodeNone] = "None",
+    [kNodeStructMember] = "StructMember",
+    [kNodeMacroReplacement] = "MacroReplacement",
+    [kASTExpr] = "Expr",
+    [kASTExprFuncCall] = "ExprFuncCall",
+    [kASTList] = "List",
+    [kASTExprStmt] = "ExprStmt",
+    [kASTJumpStmt] = "JumpStmt",
+    [kASTSelectionStmt] = "SelectionStmt",
+    [kASTIdent] = "Ident",
+    [kASTDirectDecltor] = "DirectDecltor",
+    [kASTDecltor] = "Decltor",
+    [kASTDecl] = "Decl",
+    [kASTForStmt] = "ForStmt",
+    [kASTWhileStmt] = "WhileStmt",
+    [kASTFuncDef] = "FuncDef",
+    [kASTKeyValue] = "KeyValue",
+    [kASTLocalVar] = "LocalVar",
+    [kASTStructSpec] = "StructSpec",
+    [kTypeBase] = "TypeBase",
+    [kTypeLValue] = "TypeLValue",
+    [kTypePointer] = "TypePointer",
+    [kTypeFunction] = "TypeFunction",
+    [kTypeAttrIdent] = "TypeAttrIdent",
+    [kTypeStruct] = "TypeStruct",
+    [kTypeArray] = "TypeArray",
+};
+
+const char *GetNodeTypeName(enum NodeType type) {
+  assert(0 <= type && type < kNumOfNodeTypes);
+  return node_type_names[type];
+}
+
+void StartNodeStats(void) {
+  compilation->node_stats = calloc(1, sizeof(struct NodeStats));
+  assert(compilation->node_stats);
+}
+
+void PrintNodeStats(void) {
+  // prints the nodes allocated so far by type to stderr.
+  struct NodeStats *s = compilation->node_stats;
+  const char *path =
+      compilation->input_path ? compilation->input_path : "<stdin>";
+  fprintf(stderr, "Node stats of %s:\n", path);
+  fprintf(stderr, "%-18s %10s %12s %6s\n", "type", "nodes", "bytes", "avg");
+  long total_nodes = 0;
+  long total_bytes = 0;
+  for (int i = 0; i < kNumOfNodeTypes; i++) {
+    if (!s->num_of_nodes[i]) continue;
+    fprintf(stderr, "%-18s %10ld %12ld %6ld\n", node_type_names[i],
+            s->num_of_nodes[i], s->bytes[i], s->bytes[i] / s->num_of_nodes[i]);
+    total_nodes += s->num_of_nodes[i];
+    total_bytes += s->bytes[i];
+  }
+  fprintf(stderr, "%-18s %10ld %12ld %6ld\n", "total", total_nodes,
+          total_bytes, total_nodes ? total_bytes / total_nodes : 0);
+}
+
+// Size of nodes of each type, which ends at the last field used by the type.
+#define NODE_SIZE_UNTIL(field) \
+  (offsetof(struct Node, field) + sizeof(((struct Node *)0)->field))
+
+static const size_t node_sizes[kNumOfNodeTypes] = {
+    [kNodeNone] = NODE_SIZE_UNTIL(op),
+    [kNodeStructMember] = NODE_SIZE_UNTIL(struct_member_ent_ofs),
+    [kNodeMacroReplacement] = NODE_SIZE_UNTIL(macro_body),
+    [kASTExpr] = NODE_SIZE_UNTIL(label_number),
+    [kASTExprFuncCall] = NODE_SIZE_UNTIL(stack_size_needed),
+    [kASTList] = NODE_SIZE_UNTIL(nodes),
+    [kASTExprStmt] = NODE_SIZE_UNTIL(left),
+    [kASTJumpStmt] = NODE_SIZE_UNTIL(right),
+    [kASTSelectionStmt] = NODE_SIZE_UNTIL(if_else_stmt),
+    [kASTIdent] = NODE_SIZE_UNTIL(op),
+    [kASTDirectDecltor] = NODE_SIZE_UNTIL(decltor),
+    [kASTDecltor] = NODE_SIZE_UNTIL(decltor_init_expr),
+    [kASTDecl] = NODE_SIZE_UNTIL(right),
+    [kASTForStmt] = NODE_SIZE_UNTIL(updt),
+    [kASTWhileStmt] = NODE_SIZE_UNTIL(body),
+    [kASTFuncDef] = NODE_SIZE_UNTIL(arg_var_list),
+    [kASTKeyValue] = NODE_SIZE_UNTIL(value),
+    [kASTLocalVar] = NODE_SIZE_UNTIL(byte_offset),
+    [kASTStructSpec] = NODE_SIZE_UNTIL(struct_member_dict),
+    [kTypeBase] = NODE_SIZE_UNTIL(op),
+    [kTypeLValue] = NODE_SIZE_UNTIL(right),
+    [kTypePointer] = NODE_SIZE_UNTIL(right),
+    [kTypeFunction] = NODE_SIZE_UNTIL(right),
+    [kTypeAttrIdent] = NODE_SIZE_UNTIL(right),
+    [kTypeStruct] = NODE_SIZE_UNTIL(type_struct_spec),
+    [kTypeArray] = NODE_SIZE_UNTIL(type_array_index_decl),
+};
+
 struct Node *AllocNode(enum NodeType type) {
-  struct Node *node = calloc(1, sizeof(struct Node));
+  // returns a zero-filled node which has only the fields used by type.
+  assert(0 <= type && type < kNumOfNodeTypes);
+  size_t size = node_sizes[type];
+  struct Node *node = AllocFromArena(size);
   node->type = type;
+  if (compilation->mem_report) CountMemReportAlloc(kMemSiteAllocNode, size);
+  struct NodeStats *s = compilation->node_stats;
+  if (s) {
+    s->num_of_nodes[type]++;
+    s->bytes[type] += size;
+  }
   return node;
 }
 
-struct Node *CreateASTBinOp(struct Node *t, struct Node *left,
+struct Node *CreateASTBinOp(struct Token *t, struct Node *left,
                             struct Node *right) {
   if (!right) ErrorWithToken(t, "Expected expression after binary operator");
   struct Node *op = AllocNode(kASTExpr);
@@ -16,7 +123,7 @@ struct Node *CreateASTBinOp(struct Node *t, struct Node *left,
   return op;
 }
 
-struct Node *CreateASTUnaryPrefixOp(struct Node *t, struct Node *right) {
+struct Node *CreateASTUnaryPrefixOp(struct Token *t, struct Node *right) {
   if (!right) ErrorWithToken(t, "Expected expression after prefix operator");
   struct Node *op = AllocNode(kASTExpr);
   op->op = t;
@@ -24,8 +131,8 @@ struct Node *CreateASTUnaryPrefixOp(struct Node *t, struct Node *right) {
   return op;
 }
 
-struct Node *CreateASTUnaryPostfixOp(struct Node *left, struct Node *t) {
-  assert(IsToken(t));
+struct Node *CreateASTUnaryPostfixOp(struct Node *left, struct Token *t) {
+  assert(t);
   if (!left) ErrorWithToken(t, "Expected expression before prefix operator");
   struct Node *op = AllocNode(kASTExpr);
   op->op = t;
@@ -33,7 +140,7 @@ struct Node *CreateASTUnaryPostfixOp(struct Node *left, struct Node *t) {
   return op;
 }
 
-struct Node *CreateASTExprStmt(struct Node *t, struct Node *left) {
+struct Node *CreateASTExprStmt(struct Token *t, struct Node *left) {
   struct Node *op = AllocNode(kASTExprStmt);
   op->op = t;
   op->left = left;
@@ -47,8 +154,8 @@ struct Node *CreateASTFuncDef(struct Node *func_decl, struct Node *func_body) {
   n->func_body = func_body;
   struct Node *type = CreateTypeFromDecl(func_decl);
   assert(type);
-  n->func_name_token = type->left;
-  assert(IsToken(n->func_name_token));
+  n->func_name_token = GetIdentifierTokenFromTypeAttr(type);
+  assert(n->func_name_token);
   n->func_type = GetTypeWithoutAttr(type);
   assert(n->func_type && n->func_type->type == kTypeFunction);
   return n;
@@ -68,7 +175,7 @@ struct Node *CreateASTLocalVar(int byte_offset, struct Node *var_type) {
   return n;
 }
 
-struct Node *CreateTypeBase(struct Node *t) {
+struct Node *CreateTypeBase(struct Token *t) {
   struct Node *n = AllocNode(kTypeBase);
   n->op = t;
   return n;
@@ -100,25 +207,25 @@ struct Node *GetArgTypeList(struct Node *func_type) {
   return func_type->right;
 }
 
-struct Node *CreateTypeStruct(struct Node *tag_token,
+struct Node *CreateTypeStruct(struct Token *tag_token,
                               struct Node *struct_spec) {
-  assert(IsToken(tag_token));
+  assert(tag_token);
   struct Node *n = AllocNode(kTypeStruct);
   n->tag = tag_token;
   n->type_struct_spec = struct_spec;
   return n;
 }
 
-struct Node *CreateTypeAttrIdent(struct Node *ident_token, struct Node *type) {
-  assert(ident_token && IsToken(ident_token));
+struct Node *CreateTypeAttrIdent(struct Token *ident_token, struct Node *type) {
+  assert(ident_token);
   struct Node *n = AllocNode(kTypeAttrIdent);
-  n->left = ident_token;
+  n->op = ident_token;
   n->right = type;
   return n;
 }
 
-struct Node *CreateASTIdent(struct Node *ident) {
-  assert(IsToken(ident));
+struct Node *CreateASTIdent(struct Token *ident) {
+  assert(ident);
   struct Node *n = AllocNode(kASTIdent);
   n->op = ident;
   return n;
@@ -131,152 +238,279 @@ struct Node *CreateTypeArray(struct Node *type_of, struct Node *index_decl) {
   return n;
 }
 
-struct Node *CreateMacroReplacement(struct Node *args_tokens,
-                                    struct Node *to_tokens) {
+struct Node *CreateMacroReplacement(struct TokenList *params,
+                                    struct TokenList *body) {
   struct Node *n = AllocNode(kNodeMacroReplacement);
-  n->arg_expr_list = args_tokens;
-  n->value = to_tokens;
+  n->macro_params = params;
+  n->macro_body = body;
   return n;
 }
 
-static void PrintPadding(int depth) {
+static bool HasCondField(enum NodeType type) {
+  return type == kASTExpr || type == kASTSelectionStmt ||
+         type == kASTForStmt || type == kASTWhileStmt || type == kASTLocalVar;
+}
+
+static void PrintPadding(FILE *fp, int depth) {
   for (int i = 0; i < depth; i++) {
-    fputc(' ', stderr);
+    fputc(' ', fp);
   }
 }
 
-static void PrintASTNodeSub(struct Node *n, int depth) {
+static void PrintASTNodeSub(FILE *fp, struct Node *n, int depth) {
   if (!n) {
-    fprintf(stderr, "(null)");
-    return;
-  }
-  if (IsToken(n)) {
-    PrintTokenBrief(n);
+    fprintf(fp, "(null)");
     return;
   }
   if (n->type == kASTList) {
-    fprintf(stderr, "[");
+    fprintf(fp, "[");
     if (GetSizeOfList(n) == 0) {
-      fprintf(stderr, "]");
+      fprintf(fp, "]");
       return;
     }
     for (int i = 0; i < GetSizeOfList(n); i++) {
-      fprintf(stderr, "%s\n", i ? "," : "");
-      PrintPadding(depth + 1);
-      PrintASTNodeSub(GetNodeAt(n, i), depth + 1);
+      fprintf(fp, "%s\n", i ? "," : "");
+      PrintPadding(fp, depth + 1);
+      PrintASTNodeSub(fp, GetNodeAt(n, i), depth + 1);
     }
-    fprintf(stderr, "\n");
-    PrintPadding(depth);
-    fprintf(stderr, "]");
+    fprintf(fp, "\n");
+    PrintPadding(fp, depth);
+    fprintf(fp, "]");
     return;
   } else if (n->type == kASTStructSpec) {
-    fprintf(stderr, "StructSpec: ");
-    PrintASTNodeSub(n->struct_member_dict, depth);
+    fprintf(fp, "StructSpec: ");
+    PrintASTNodeSub(fp, n->struct_member_dict, depth);
     return;
   } else if (n->type == kASTKeyValue) {
-    fprintf(stderr, "%s: ", n->key);
-    PrintASTNodeSub(n->value, depth);
+    fprintf(fp, "%s: ", n->key);
+    PrintASTNodeSub(fp, n->value, depth);
     return;
   } else if (n->type == kNodeStructMember) {
-    fprintf(stderr, "Member +%d: ", n->struct_member_ent_ofs);
-    PrintASTNodeSub(n->struct_member_ent_type, depth);
+    fprintf(fp, "Member +%d: ", n->struct_member_ent_ofs);
+    PrintASTNodeSub(fp, n->struct_member_ent_type, depth);
     return;
   } else if (n->type == kNodeMacroReplacement) {
-    fprintf(stderr, "MacroReplacement<args: ");
-    PrintASTNodeSub(n->arg_expr_list, depth);
-    fprintf(stderr, ", rep: ");
-    PrintTokenSequence(n->value);
-    fprintf(stderr, ">");
+    fprintf(fp, "MacroReplacement<args: ");
+    PrintTokenList(n->macro_params, fp);
+    fprintf(fp, ", rep: ");
+    PrintTokenList(n->macro_body, fp);
+    fprintf(fp, ">");
     return;
   } else if (n->type == kTypeBase) {
-    PrintTokenStrToFile(n->op, stderr);
+    PrintTokenStrToFile(n->op, fp);
     return;
   } else if (n->type == kTypeLValue) {
-    fprintf(stderr, "lvalue<");
-    PrintASTNodeSub(n->right, depth);
-    fprintf(stderr, ">");
+    fprintf(fp, "lvalue<");
+    PrintASTNodeSub(fp, n->right, depth);
+    fprintf(fp, ">");
     return;
   } else if (n->type == kTypePointer) {
-    fprintf(stderr, "pointer_of<");
-    PrintASTNodeSub(n->right, depth);
-    fprintf(stderr, ">");
+    fprintf(fp, "pointer_of<");
+    PrintASTNodeSub(fp, n->right, depth);
+    fprintf(fp, ">");
     return;
   } else if (n->type == kTypeFunction) {
-    fprintf(stderr, "function<returns: ");
-    PrintASTNodeSub(n->left, depth);
-    fprintf(stderr, ", args: ");
-    PrintASTNodeSub(n->right, depth);
-    fprintf(stderr, ">");
+    fprintf(fp, "function<returns: ");
+    PrintASTNodeSub(fp, n->left, depth);
+    fprintf(fp, ", args: ");
+    PrintASTNodeSub(fp, n->right, depth);
+    fprintf(fp, ">");
     return;
   } else if (n->type == kTypeStruct) {
-    fprintf(stderr, "struct<tag: ");
-    PrintASTNodeSub(n->tag, depth);
+    fprintf(fp, "struct<tag: ");
+    PrintTokenBrief(n->tag, fp);
     if (!n->type_struct_spec) {
-      fprintf(stderr, ", incomplete");
+      fprintf(fp, ", incomplete");
     }
-    fprintf(stderr, ">");
+    fprintf(fp, ">");
     return;
   } else if (n->type == kTypeArray) {
-    fprintf(stderr, "array_of<");
-    PrintASTNodeSub(n->type_array_type_of, depth);
-    fprintf(stderr, ">[");
-    PrintASTNodeSub(n->type_array_index_decl, depth);
-    fprintf(stderr, "]");
+    fprintf(fp, "array_of<");
+    PrintASTNodeSub(fp, n->type_array_type_of, depth);
+    fprintf(fp, ">[");
+    PrintASTNodeSub(fp, n->type_array_index_decl, depth);
+    fprintf(fp, "]");
     return;
   } else if (n->type == kTypeAttrIdent) {
-    fputc('`', stderr);
-    PrintTokenStrToFile(n->left, stderr);
-    fputc('`', stderr);
-    fprintf(stderr, " has a type: ");
-    PrintASTNodeSub(n->right, depth);
+    fputc('`', fp);
+    PrintTokenStrToFile(n->op, fp);
+    fputc('`', fp);
+    fprintf(fp, " has a type: ");
+    PrintASTNodeSub(fp, n->right, depth);
     return;
   } else if (n->type == kASTFuncDef) {
-    fprintf(stderr, "FuncDef ");
-    PrintASTNodeSub(n->func_name_token, depth);
-    fprintf(stderr, " : ");
-    PrintASTNodeSub(n->func_type, depth);
-    fprintf(stderr, "{\n");
-    PrintPadding(depth + 1);
-    PrintASTNodeSub(n->func_body, depth + 1);
-    fprintf(stderr, "\n");
-    PrintPadding(depth);
-    fprintf(stderr, "}");
+    fprintf(fp, "FuncDef ");
+    PrintTokenBrief(n->func_name_token, fp);
+    fprintf(fp, " : ");
+    PrintASTNodeSub(fp, n->func_type, depth);
+    fprintf(fp, "{\n");
+    PrintPadding(fp, depth + 1);
+    PrintASTNodeSub(fp, n->func_body, depth + 1);
+    fprintf(fp, "\n");
+    PrintPadding(fp, depth);
+    fprintf(fp, "}");
     return;
   } else if (n->type == kASTExprStmt) {
-    PrintASTNodeSub(n->left, depth);
-    fprintf(stderr, ";");
+    PrintASTNodeSub(fp, n->left, depth);
+    fprintf(fp, ";");
     return;
   } else if (n->type == kASTExprFuncCall) {
-    fprintf(stderr, "FuncCall<");
-    PrintASTNodeSub(n->func_expr, depth);
-    fprintf(stderr, ">(");
-    PrintASTNodeSub(n->arg_expr_list, depth);
-    fprintf(stderr, ")");
+    fprintf(fp, "FuncCall<");
+    PrintASTNodeSub(fp, n->func_expr, depth);
+    fprintf(fp, ">(");
+    PrintASTNodeSub(fp, n->arg_expr_list, depth);
+    fprintf(fp, ")");
     return;
   }
-  fprintf(stderr, "(op=");
-  if (n->op) PrintTokenBrief(n->op);
+  fprintf(fp, "(op=");
+  if (n->op) PrintTokenBrief(n->op, fp);
   if (n->expr_type) {
-    fprintf(stderr, ":");
-    PrintASTNodeSub(n->expr_type, depth + 1);
+    fprintf(fp, ":");
+    PrintASTNodeSub(fp, n->expr_type, depth + 1);
+  }
+  if (n->reg) fprintf(fp, " reg: %d", n->reg);
+  if (n->type == kASTIdent || n->type == kNodeNone) {
+    // nodes of these types have no operands.
+    fprintf(fp, ")");
+    return;
   }
-  if (n->reg) fprintf(stderr, " reg: %d", n->reg);
-  if (n->cond) {
-    fprintf(stderr, " cond=");
-    PrintASTNodeSub(n->cond, depth + 1);
+  if (HasCondField(n->type) && n->cond) {
+    fprintf(fp, " cond=");
+    PrintASTNodeSub(fp, n->cond, depth + 1);
   }
   if (n->left) {
-    fprintf(stderr, " L=");
-    PrintASTNodeSub(n->left, depth + 1);
+    fprintf(fp, " L=");
+    PrintASTNodeSub(fp, n->left, depth + 1);
   }
   if (n->right) {
-    fprintf(stderr, " R=");
-    PrintASTNodeSub(n->right, depth + 1);
+    fprintf(fp, " R=");
+    PrintASTNodeSub(fp, n->right, depth + 1);
   }
-  fprintf(stderr, ")");
+  fprintf(fp, ")");
+}
+
+void PrintASTNodeToFile(struct Node *n, FILE *fp) {
+  PrintASTNodeSub(fp, n, 0);
+  fputc('\n', fp);
 }
 
 void PrintASTNode(struct Node *n) {
-  PrintASTNodeSub(n, 0);
-  fputc('\n', stderr);
+  PrintASTNodeToFile(n, stderr);
+}
+
+// Nodes are written as JSON objects with their type and the fields set for
+// the type, except that lists are written as arrays. As in the text form,
+// struct types are written by tag, since their members may refer to them.
+
+static void PrintASTNodeAsJSONSub(FILE *fp, struct Node *n);
+
+static void PrintJSONNodeField(FILE *fp, const char *key, struct Node *n) {
+  if (!n) return;
+  fprintf(fp, ", \"%s\": ", key);
+  PrintASTNodeAsJSONSub(fp, n);
+}
+
+static void PrintJSONTokenField(FILE *fp, const char *key, struct Token *t) {
+  if (!t) return;
+  fprintf(fp, ", \"%s\": ", key);
+  PrintJSONString(fp, GetTokenBegin(t), t->length);
+}
+
+static void PrintASTNodeAsJSONSub(FILE *fp, struct Node *n) {
+  if (!n) {
+    fprintf(fp, "null");
+    return;
+  }
+  if (n->type == kASTList) {
+    fprintf(fp, "[");
+    for (int i = 0; i < GetSizeOfList(n); i++) {
+      if (i) fprintf(fp, ", ");
+      PrintASTNodeAsJSONSub(fp, GetNodeAt(n, i));
+    }
+    fprintf(fp, "]");
+    return;
+  }
+  fprintf(fp, "{\"type\": \"%s\"", GetNodeTypeName(n->type));
+  PrintJSONTokenField(fp, "op", n->op);
+  PrintJSONNodeField(fp, "expr_type", n->expr_type);
+  if (n->reg) fprintf(fp, ", \"reg\": %d", n->reg);
+  switch (n->type) {
+    case kNodeNone:
+    case kASTIdent:
+    case kTypeBase:
+    case kNodeMacroReplacement:
+      break;
+    case kNodeStructMember:
+      fprintf(fp, ", \"offset\": %d", n->struct_member_ent_ofs);
+      PrintJSONNodeField(fp, "ent_type", n->struct_member_ent_type);
+      break;
+    case kASTExprFuncCall:
+      PrintJSONNodeField(fp, "func_expr", n->func_expr);
+      PrintJSONNodeField(fp, "args", n->arg_expr_list);
+      break;
+    case kASTExprStmt:
+      PrintJSONNodeField(fp, "left", n->left);
+      break;
+    case kASTSelectionStmt:
+      PrintJSONNodeField(fp, "cond", n->cond);
+      PrintJSONNodeField(fp, "if_true_stmt", n->if_true_stmt);
+      PrintJSONNodeField(fp, "if_else_stmt", n->if_else_stmt);
+      break;
+    case kASTForStmt:
+      PrintJSONNodeField(fp, "init", n->init);
+      PrintJSONNodeField(fp, "cond", n->cond);
+      PrintJSONNodeField(fp, "updt", n->updt);
+      PrintJSONNodeField(fp, "body", n->body);
+      break;
+    case kASTWhileStmt:
+      PrintJSONNodeField(fp, "cond", n->cond);
+      PrintJSONNodeField(fp, "body", n->body);
+      break;
+    case kASTDirectDecltor:
+      PrintJSONNodeField(fp, "left", n->left);
+      PrintJSONNodeField(fp, "right", n->right);
+      PrintJSONNodeField(fp, "decltor", n->decltor);
+      break;
+    case kASTDecltor:
+      PrintJSONNodeField(fp, "left", n->left);
+      PrintJSONNodeField(fp, "right", n->right);
+      PrintJSONNodeField(fp, "init_expr", n->decltor_init_expr);
+      break;
+    case kASTFuncDef:
+      PrintJSONTokenField(fp, "name", n->func_name_token);
+      PrintJSONNodeField(fp, "func_type", n->func_type);
+      PrintJSONNodeField(fp, "body", n->func_body);
+      break;
+    case kASTKeyValue:
+      fprintf(fp, ", \"key\": ");
+      PrintJSONString(fp, n->key, strlen(n->key));
+      PrintJSONNodeField(fp, "value", n->value);
+      break;
+    case kASTLocalVar:
+      fprintf(fp, ", \"byte_offset\": %d", n->byte_offset);
+      break;
+    case kASTStructSpec:
+      PrintJSONNodeField(fp, "members", n->struct_member_dict);
+      break;
+    case kTypeStruct:
+      PrintJSONTokenField(fp, "tag", n->tag);
+      fprintf(fp, ", \"is_complete\": %s",
+              n->type_struct_spec ? "true" : "false");
+      break;
+    case kTypeArray:
+      PrintJSONNodeField(fp, "type_of", n->type_array_type_of);
+      PrintJSONNodeField(fp, "index_decl", n->type_array_index_decl);
+      break;
+    default:
+      // kASTExpr, kASTJumpStmt, kASTDecl and the other types
+      if (n->type == kASTExpr) PrintJSONNodeField(fp, "cond", n->cond);
+      PrintJSONNodeField(fp, "left", n->left);
+      PrintJSONNodeField(fp, "right", n->right);
+      break;
+  }
+  fprintf(fp, "}");
+}
+
+void PrintASTNodeAsJSON(struct Node *n, FILE *fp) {
+  PrintASTNodeAsJSONSub(fp, n);
 }
@@ -0,0 +1,78 @@
+#include "compilium.h"
+
+// Atoms are small integers that identify a spelling of an identifier within
+// a compilation. Every identifier and keyword token is interned when it is
+// lexed, so names are compared by atom instead of by string. Atom 0 is never
+// assigned and marks tokens without a name.
+
+struct Atom {
+  const char *str;  // NUL-terminated copy of the spelling
+  int length;
+  unsigned hash;
+};
+
+static unsigned HashAtomStr(const char *s, int length) {
+  // FNV-1a
+  unsigned hash = 2166136261u;
+  for (int i = 0; i < length; i++) {
+    hash ^= (unsigned char)s[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void InsertAtomToHashTable(int atom) {
+  int mask = compilation->atom_hash_table_size - 1;
+  int i = compilation->atoms[atom].hash & mask;
+  while (compilation->atom_hash_table[i]) i = (i + 1) & mask;
+  compilation->atom_hash_table[i] = atom;
+}
+
+static void ExpandAtomTableIfNeeded(void) {
+  if (compilation->num_of_atoms >= compilation->atoms_capacity) {
+    compilation->atoms_capacity = (compilation->atoms_capacity + 1) * 2;
+    compilation->atoms = realloc(
+        compilation->atoms, sizeof(struct Atom) * compilation->atoms_capacity);
+    assert(compilation->atoms);
+  }
+  // keep the hash table at most half full
+  if (compilation->num_of_atoms * 2 < compilation->atom_hash_table_size) return;
+  compilation->atom_hash_table_size =
+      compilation->atom_hash_table_size ? compilation->atom_hash_table_size * 2
+                                        : 256;
+  compilation->atom_hash_table =
+      calloc(compilation->atom_hash_table_size, sizeof(int));
+  assert(compilation->atom_hash_table);
+  for (int atom = 1; atom < compilation->num_of_atoms; atom++) {
+    InsertAtomToHashTable(atom);
+  }
+}
+
+int InternAtom(const char *s, int length) {
+  // returns the atom for s[0..length), adding it if it is new.
+  if (!compilation->num_of_atoms) compilation->num_of_atoms = 1;
+  ExpandAtomTableIfNeeded();
+  unsigned hash = HashAtomStr(s, length);
+  int mask = compilation->atom_hash_table_size - 1;
+  int i = hash & mask;
+  int atom;
+  while ((atom = compilation->atom_hash_table[i])) {
+    struct Atom *a = &compilation->atoms[atom];
+    if (a->hash == hash && a->length == length &&
+        memcmp(a->str, s, length) == 0)
+      return atom;
+    i = (i + 1) & mask;
+  }
+  atom = compilation->num_of_atoms++;
+  struct Atom *a = &compilation->atoms[atom];
+  a->str = CopyStrToArena(s, length);
+  a->length = length;
+  a->hash = hash;
+  compilation->atom_hash_table[i] = atom;
+  return atom;
+}
+
+const char *GetAtomStr(int atom) {
+  assert(0 < atom && atom < compilation->num_of_atoms);
+  return compilation->atoms[atom].str;
+}
@@ -1,7 +1,23 @@
 #include "compilium.h"
 
 const char *symbol_prefix;
+static const char *target_os_macro;
 bool is_preprocess_only = false;
+static bool has_line_markers = true;
+static bool is_benchmark_tokenizer = false;
+static const char *emit_pch_path;
+static const char *emit_ast_path;
+static const char *load_ast_path;
+static bool has_dependency_file = false;
+static const char *dependency_file_path;
+static bool skip_if_unchanged = false;
+static bool has_macro_stats = false;
+static bool is_macro_stats_json = false;
+static bool has_node_stats = false;
+static bool has_mem_report = false;
+static const char **input_paths;
+static int num_of_input_paths;
+static int num_of_workers;
 
 _Noreturn void Error(const char *fmt, ...) {
   fflush(stdout);
@@ -20,15 +36,25 @@ _Noreturn void __assert(const char *expr_str, const char *file, int line) {
 
 void TestList(void);
 void TestType(void);
+void TestTokenizer(void);
+void TestPPExpr(void);
 void ParseCompilerArgs(int argc, char **argv) {
   symbol_prefix = "_";
+  target_os_macro = "__APPLE__";
+  input_paths = calloc(argc, sizeof(const char *));
+  // Options which change the output are passed to AddOutputOption, so that
+  // --skip-if-unchanged recompiles outputs written with other options.
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "--target-os") == 0) {
       i++;
+      AddOutputOption("--target-os");
+      AddOutputOption(argv[i]);
       if (strcmp(argv[i], "Darwin") == 0) {
         symbol_prefix = "_";
+        target_os_macro = "__APPLE__";
       } else if (strcmp(argv[i], "Linux") == 0) {
         symbol_prefix = "";
+        target_os_macro = "__linux__";
       } else {
         Error("Unknown os type %s", argv[i]);
       }
@@ -36,30 +62,101 @@ void ParseCompilerArgs(int argc, char **argv) {
       TestList();
     } else if (strcmp(argv[i], "--run-unittest=Type") == 0) {
       TestType();
+    } else if (strcmp(argv[i], "--run-unittest=Tokenizer") == 0) {
+      TestTokenizer();
+    } else if (strcmp(argv[i], "--run-unittest=PPExpr") == 0) {
+      TestPPExpr();
+    } else if (strcmp(argv[i], "--run-benchmark=Tokenizer") == 0) {
+      is_benchmark_tokenizer = true;
     } else if (strcmp(argv[i], "-E") == 0) {
       is_preprocess_only = true;
+      AddOutputOption(argv[i]);
+    } else if (strcmp(argv[i], "-P") == 0) {
+      has_line_markers = false;
+      AddOutputOption(argv[i]);
+    } else if (strcmp(argv[i], "-j") == 0) {
+      i++;
+      if (i >= argc || (num_of_workers = strtol(argv[i], NULL, 10)) <= 0)
+        Error("-j requires a positive number of workers");
+    } else if (strcmp(argv[i], "--emit-pch") == 0) {
+      if (++i >= argc) Error("--emit-pch requires an output path");
+      emit_pch_path = argv[i];
+    } else if (strcmp(argv[i], "--include-pch") == 0) {
+      if (++i >= argc) Error("--include-pch requires a path");
+      AddOutputOption("--include-pch");
+      AddOutputOption(argv[i]);
+      MapPrecompiledHeader(argv[i]);
+    } else if (strncmp(argv[i], "--emit-ast=", 11) == 0) {
+      emit_ast_path = &argv[i][11];
+    } else if (strncmp(argv[i], "--load-ast=", 11) == 0) {
+      // generates code from the AST instead of the input if the input is
+      // the same as the one the AST was made from.
+      load_ast_path = &argv[i][11];
+    } else if (strcmp(argv[i], "-MD") == 0) {
+      has_dependency_file = true;
+    } else if (strcmp(argv[i], "-MF") == 0) {
+      if (++i >= argc) Error("-MF requires a path");
+      has_dependency_file = true;
+      dependency_file_path = argv[i];
+    } else if (strcmp(argv[i], "--skip-if-unchanged") == 0) {
+      // recompiles an input only if a file recorded in its .d has changed.
+      // Only for multiple inputs, which are written to foo.S.
+      has_dependency_file = true;
+      skip_if_unchanged = true;
+    } else if (strcmp(argv[i], "--macro-stats") == 0) {
+      has_macro_stats = true;
+    } else if (strcmp(argv[i], "--macro-stats=json") == 0) {
+      has_macro_stats = true;
+      is_macro_stats_json = true;
+    } else if (strcmp(argv[i], "--node-stats") == 0) {
+      has_node_stats = true;
+    } else if (strcmp(argv[i], "--mem-report") == 0) {
+      has_mem_report = true;
+    } else if (strncmp(argv[i], "--dump=", 7) == 0) {
+      AddDumpKinds(&argv[i][7]);
+    } else if (strncmp(argv[i], "--dump-format=", 14) == 0) {
+      SetDumpFormat(&argv[i][14]);
+    } else if (strncmp(argv[i], "-I", 2) == 0) {
+      // -I dir or -Idir
+      const char *dir = &argv[i][2];
+      if (!*dir) {
+        if (++i >= argc) Error("-I requires a directory");
+        dir = argv[i];
+      }
+      AddOutputOption("-I");
+      AddOutputOption(dir);
+      AddIncludeDir(dir);
+    } else if (argv[i][0] != '-') {
+      input_paths[num_of_input_paths++] = argv[i];
     } else {
       Error("Unknown argument: %s", argv[i]);
     }
   }
+  // Headers in include/ next to the executable are searched last.
+  int dir_length = 0;
+  for (int i = 0; argv[0][i]; i++) {
+    if (argv[0][i] == '/') dir_length = i;
+  }
+  int size = dir_length + sizeof("/include");
+  char *system_include_dir = malloc(size);
+  snprintf(system_include_dir, size, "%.*s%sinclude", dir_length, argv[0],
+           dir_length ? "/" : "");
+  AddIncludeDir(system_include_dir);
 }
 
-void PrintTokenLine(struct Node *t) {
+void PrintTokenLine(struct Token *t) {
   assert(t);
-  const char *line_begin = t->begin;
-  while (t->src_str < line_begin) {
-    if (line_begin[-1] == '\n') break;
-    line_begin--;
-  }
+  const char *begin = GetTokenBegin(t);
+  const char *line_begin = GetSourceLineBegin(t->loc);
 
-  fprintf(stderr, "Line %d:\n", t->line);
+  fprintf(stderr, "Line %d:\n", GetSourceLine(t->loc));
 
   for (const char *p = line_begin; *p && *p != '\n'; p++) {
     fputc(*p <= ' ' ? ' ' : *p, stderr);
   }
   fputc('\n', stderr);
   const char *p;
-  for (p = line_begin; p < t->begin; p++) {
+  for (p = line_begin; p < begin; p++) {
     fputc(' ', stderr);
   }
   for (int i = 0; i < t->length; i++) {
@@ -72,7 +169,7 @@ void PrintTokenLine(struct Node *t) {
   fputc('\n', stderr);
 }
 
-_Noreturn void ErrorWithToken(struct Node *t, const char *fmt, ...) {
+_Noreturn void ErrorWithToken(struct Token *t, const char *fmt, ...) {
   PrintTokenLine(t);
 
   fprintf(stderr, "Error: ");
@@ -90,7 +187,12 @@ struct Node *AllocList() {
 
 void ExpandListSizeIfNeeded(struct Node *list) {
   if (list->size < list->capacity) return;
+  int old_capacity = list->capacity;
   list->capacity = (list->capacity + 1) * 2;
+  if (compilation->mem_report) {
+    int growth = list->capacity - old_capacity;
+    CountMemReportAlloc(kMemSiteExpandList, sizeof(struct Node *) * growth);
+  }
   list->nodes = realloc(list->nodes, sizeof(struct Node *) * list->capacity);
   assert(list->nodes);
   assert(list->size < list->capacity);
@@ -108,6 +210,16 @@ void PushKeyValueToList(struct Node *list, const char *key,
   list->nodes[list->size++] = CreateASTKeyValue(key, value);
 }
 
+void PushTokenKeyValueToList(struct Node *list, struct Token *key,
+                             struct Node *value) {
+  // the key of the pushed entry is compared by atom in GetNodeByTokenKey.
+  assert(key && key->atom && value);
+  ExpandListSizeIfNeeded(list);
+  struct Node *kv = CreateASTKeyValue(GetAtomStr(key->atom), value);
+  kv->key_atom = key->atom;
+  list->nodes[list->size++] = kv;
+}
+
 int GetSizeOfList(struct Node *list) {
   assert(list && list->type == kASTList);
   return list->size;
@@ -119,12 +231,13 @@ struct Node *GetNodeAt(struct Node *list, int index) {
   return list->nodes[index];
 }
 
-struct Node *GetNodeByTokenKey(struct Node *list, struct Node *key) {
+struct Node *GetNodeByTokenKey(struct Node *list, struct Token *key) {
   assert(list && list->type == kASTList);
+  if (!key || !key->atom) return NULL;
   for (int i = 0; i < list->size; i++) {
     struct Node *n = list->nodes[i];
     if (n->type != kASTKeyValue) continue;
-    if (IsEqualTokenWithCStr(key, n->key)) return n->value;
+    if (n->key_atom == key->atom) return n->value;
   }
   return NULL;
 }
@@ -187,157 +300,448 @@ const char *param_reg_names_32[NUM_OF_PARAM_REGISTERS] = {"edi", "esi", "edx",
 const char *param_reg_names_8[NUM_OF_PARAM_REGISTERS] = {"dl", "sil", "dl",
                                                          "cl", "r8b", "r9b"};
 
-static struct Node *SkipDelimiterTokensInLogicalLine(struct Node *t) {
-  while (t && t->token_type == kTokenDelimiter &&
-         !IsEqualTokenWithCStr(t, "\n"))
-    t = t->next_token;
+static struct Token *PeekTokenInLogicalLine(void) {
+  // skips delimiters other than the end of line and peeks the next token.
+  struct Token *t;
+  while ((t = PeekToken()) && t->type == kTokenDelimiter &&
+         !IsEndOfLineToken(t))
+    NextToken();
   return t;
 }
 
-void Preprocess(struct Node **head_holder) {
-  InitTokenStream(head_holder);
-  struct Node *replacement_list = AllocList();
-  struct Node *t, *e;
-  while (PeekToken()) {
-    if ((t = ConsumeTokenStr("__LINE__"))) {
-      char s[32];
-      snprintf(s, sizeof(s), "%d", t->line);
-      t->token_type = kTokenDecimalNumber;
-      t->begin = t->src_str = strdup(s);
-      t->length = strlen(t->begin);
-      continue;
+static void SkipToNextLine(void) {
+  // skips the rest of the line and the end of line.
+  struct Token *t;
+  while ((t = PeekToken()) && !IsEndOfLineToken(t)) NextToken();
+  NextToken();
+}
+
+static void ReadInclude(struct Token *directive) {
+  // reads the rest of #include "name" or #include <name>.
+  struct Token *t = PeekTokenInLogicalLine();
+  if (IsTokenWithType(t, kTokenStringLiteral)) {
+    struct Token name = *NextToken();
+    SkipToNextLine();
+    IncludeHeader(directive, GetTokenBegin(&name) + 1, name.length - 2, true);
+    return;
+  }
+  if (!IsPunctToken(t, kPunctLt))
+    ErrorWithToken(directive, "Expected \"name\" or <name>");
+  const char *name = GetTokenBegin(NextToken()) + 1;
+  while ((t = PeekToken()) && !IsEndOfLineToken(t) &&
+         !IsPunctToken(t, kPunctGt))
+    NextToken();
+  if (!IsPunctToken(t, kPunctGt)) ErrorWithToken(directive, "Expected >");
+  int name_length = GetTokenBegin(NextToken()) - name;
+  SkipToNextLine();
+  IncludeHeader(directive, name, name_length, false);
+}
+
+static struct TokenList *ReadMacroParams(void) {
+  // returns NULL for object-like macros, whose name is not followed by ( .
+  if (!IsPunctToken(PeekToken(), kPunctLParen)) return NULL;
+  NextToken();
+  struct TokenList *params = AllocTokenList();
+  struct Token *t;
+  while ((t = PeekTokenInLogicalLine())) {
+    if (IsPunctToken(t, kPunctRParen)) break;
+    PushTokenToList(params, NextToken());
+    if (!IsPunctToken(PeekTokenInLogicalLine(), kPunctComma)) break;
+    NextToken();
+  }
+  t = NextToken();
+  if (!IsPunctToken(t, kPunctRParen)) ErrorWithToken(t, "Expected ) here");
+  return params;
+}
+
+static struct TokenSlice *ReadMacroArgs(struct Token *macro_name,
+                                        struct TokenList *params) {
+  // returns slices of args, which are valid until the next call.
+  struct Token *t = NextToken();
+  if (!IsPunctToken(t, kPunctLParen)) ErrorWithToken(t, "Expected ( here");
+  if (params->size > compilation->macro_args_capacity) {
+    compilation->macro_args_capacity = params->size * 2;
+    compilation->macro_args =
+        realloc(compilation->macro_args, sizeof(struct TokenSlice) *
+                                             compilation->macro_args_capacity);
+    assert(compilation->macro_args);
+  }
+  // args is NULL until a macro with params is called.
+  struct TokenSlice *args = compilation->macro_args;
+  if (params->size) memset(args, 0, sizeof(struct TokenSlice) * params->size);
+  for (int i = 0; i < params->size; i++) {
+    int depth = 0;
+    BeginTokenSlice(&args[i]);
+    PeekTokenInLogicalLine();
+    while ((t = PeekToken())) {
+      if (!depth &&
+          (IsPunctToken(t, kPunctRParen) || IsPunctToken(t, kPunctComma)))
+        break;
+      if (IsPunctToken(t, kPunctLParen)) depth++;
+      if (IsPunctToken(t, kPunctRParen)) depth--;
+      AppendTokenToSlice(&args[i], NextToken());
+    }
+    if (IsPunctToken(t, kPunctRParen)) break;
+    NextToken();
+  }
+  t = NextToken();
+  if (!t) ErrorWithToken(macro_name, "Unterminated macro call");
+  if (!IsPunctToken(t, kPunctRParen)) ErrorWithToken(t, "Expected ) here");
+  return args;
+}
+
+static bool ExpandMacro(struct Token *t) {
+  // inserts the replacement of t if t is a macro. returns false otherwise.
+  // t should be the next token.
+  struct Node *e;
+  if (t->type != kTokenIdent || IsNextTokenExpanded() || !(e = FindMacro(t)))
+    return false;
+  assert(e->type == kNodeMacroReplacement);
+  unsigned origin_loc = GetExpansionOrigin();
+  // The expansions which macro_name is read from are still active.
+  if (compilation->macro_stats) UpdateMacroStats();
+  struct Token macro_name = *NextToken();
+  if (!e->macro_params) {
+    // ident replace macro case
+    if (compilation->macro_stats) BeginMacroStats(&macro_name);
+    struct TokenList *expanded = GetExpandedMacroBody(&macro_name);
+    if (expanded) {
+      InsertExpandedTokens(expanded, origin_loc);
+    } else {
+      InsertTokens(e->macro_body, origin_loc);
     }
-    if ((t = ReadToken(kTokenLineComment))) {
-      while (t && !IsEqualTokenWithCStr(t, "\n")) t = t->next_token;
-      RemoveTokensUpTo(t);
+    return true;
+  }
+  // function-like macro case
+  RecycleTokenPool();
+  PeekTokenInLogicalLine();
+  struct TokenSlice *args = ReadMacroArgs(&macro_name, e->macro_params);
+  // Insert & replace args
+  if (compilation->macro_stats) BeginMacroStats(&macro_name);
+  InsertTokensWithArgs(e->macro_body, e->macro_params, args, origin_loc);
+  return true;
+}
+
+// Conditional inclusion
+//
+// Each #if, #ifdef and #ifndef pushes a conditional which is popped by its
+// #endif. Groups which are not taken are skipped by SkipInactiveGroup without
+// being tokenized.
+
+struct Conditional {
+  struct Token directive;
+  bool is_taken;  // true once a group of the conditional is taken
+  bool has_else;
+};
+
+static void PushConditional(struct Token *directive, bool is_taken) {
+  // the rest of the line of directive should be consumed already.
+  if (compilation->num_of_conditionals >= compilation->conditionals_capacity) {
+    compilation->conditionals_capacity =
+        (compilation->conditionals_capacity + 1) * 2;
+    compilation->conditionals = realloc(
+        compilation->conditionals,
+        sizeof(struct Conditional) * compilation->conditionals_capacity);
+    assert(compilation->conditionals);
+  }
+  struct Conditional *c =
+      &compilation->conditionals[compilation->num_of_conditionals++];
+  c->directive = *directive;
+  c->is_taken = is_taken;
+  c->has_else = false;
+  if (!is_taken) SkipInactiveGroup();
+}
+
+static struct Conditional *GetCurrentConditional(struct Token *directive) {
+  if (!compilation->num_of_conditionals)
+    ErrorWithToken(directive, "No #if for this directive");
+  return &compilation->conditionals[compilation->num_of_conditionals - 1];
+}
+
+static bool ReadIfdefCondition(struct Token *directive) {
+  // returns true if the macro is defined.
+  struct Token *name = PeekTokenInLogicalLine();
+  if (!IsTokenWithType(name, kTokenIdent))
+    ErrorWithToken(directive, "Expected macro name");
+  bool is_defined = FindMacro(NextToken()) != NULL;
+  SkipToNextLine();
+  return is_defined;
+}
+
+static bool ReadDefinedOperator(struct Token *directive) {
+  // reads defined X or defined(X) and returns true if X is defined.
+  NextToken();
+  bool has_paren = IsPunctToken(PeekTokenInLogicalLine(), kPunctLParen);
+  if (has_paren) NextToken();
+  if (!IsTokenWithType(PeekTokenInLogicalLine(), kTokenIdent))
+    ErrorWithToken(directive, "Expected macro name after defined");
+  bool is_defined = FindMacro(NextToken()) != NULL;
+  if (has_paren && !IsPunctToken(PeekTokenInLogicalLine(), kPunctRParen))
+    ErrorWithToken(directive, "Expected ) after defined");
+  if (has_paren) NextToken();
+  return is_defined;
+}
+
+static bool ReadIfCondition(struct Token *directive) {
+  // returns true if the expression of #if or #elif is not zero.
+  struct TokenList *expr = AllocTokenList();
+  struct Token *t;
+  while ((t = PeekTokenInLogicalLine()) && !IsEndOfLineToken(t)) {
+    if (IsEqualTokenWithCStr(t, "defined")) {
+      PushTokenToList(expr,
+                      CreateToken(ReadDefinedOperator(directive) ? "1" : "0"));
       continue;
     }
-    if ((t = ReadToken(kTokenBlockCommentBegin))) {
-      while (t && !IsTokenWithType(t, kTokenBlockCommentEnd)) t = t->next_token;
-      if (IsTokenWithType(t, kTokenBlockCommentEnd)) t = t->next_token;
-      RemoveTokensUpTo(t);
+    if (ExpandMacro(t)) continue;
+    PushTokenToList(expr, NextToken());
+  }
+  SkipToNextLine();
+  if (!expr->size) ErrorWithToken(directive, "Expected an expression");
+  return EvalPreprocessorExpr(expr) != 0;
+}
+
+static bool ReadConditionalDirective(struct Token *t) {
+  // handles t if t is the name of a conditional directive.
+  if (IsEqualTokenWithCStr(t, "ifdef") || IsEqualTokenWithCStr(t, "ifndef")) {
+    struct Token directive = *NextToken();
+    bool is_ifdef = IsEqualTokenWithCStr(&directive, "ifdef");
+    PushConditional(&directive, ReadIfdefCondition(&directive) == is_ifdef);
+    return true;
+  }
+  if (IsTokenWithType(t, kTokenKwIf)) {
+    struct Token directive = *NextToken();
+    PushConditional(&directive, ReadIfCondition(&directive));
+    return true;
+  }
+  if (IsEqualTokenWithCStr(t, "elif")) {
+    struct Token directive = *NextToken();
+    struct Conditional *c = GetCurrentConditional(&directive);
+    if (c->has_else) ErrorWithToken(&directive, "#elif after #else");
+    if (c->is_taken) {
+      SkipToNextLine();
+      SkipInactiveGroup();
+    } else if (ReadIfCondition(&directive)) {
+      c->is_taken = true;
+    } else {
+      SkipInactiveGroup();
+    }
+    return true;
+  }
+  if (IsTokenWithType(t, kTokenKwElse)) {
+    struct Token directive = *NextToken();
+    struct Conditional *c = GetCurrentConditional(&directive);
+    if (c->has_else) ErrorWithToken(&directive, "#else after #else");
+    c->has_else = true;
+    SkipToNextLine();
+    if (c->is_taken) {
+      SkipInactiveGroup();
+    } else {
+      c->is_taken = true;
+    }
+    return true;
+  }
+  if (IsEqualTokenWithCStr(t, "endif")) {
+    struct Token directive = *NextToken();
+    GetCurrentConditional(&directive);
+    compilation->num_of_conditionals--;
+    SkipToNextLine();
+    return true;
+  }
+  return false;
+}
+
+static void EmitPreprocessedToken(struct TokenList *output, struct Token *t,
+                                  unsigned origin_loc) {
+  // With -E, tokens are written out as soon as they are preprocessed, and
+  // kept only for --dump=pp. Otherwise only the tokens which the parser reads
+  // are kept.
+  if (compilation->macro_stats && t->type != kTokenDelimiter)
+    CountMacroStatsToken();
+  if (is_preprocess_only) {
+    WritePreprocessedToken(t, origin_loc);
+    if (!compilation->dump || !IsDumpKindEnabled(kDumpPreprocessed)) return;
+  }
+  if (t->type == kTokenDelimiter || t->type == kTokenZeroWidthNoBreakSpace)
+    return;
+  PushTokenToList(output, t);
+}
+
+struct TokenList *Preprocess(const char *input) {
+  // returns tokens of input with comments, delimiters and directives removed
+  // and macros expanded. Tokens are lexed on demand from input, so tokens
+  // read from the stream are copied if they are used later.
+  InitTokenStreamFromInput(input, compilation->input_path);
+  struct TokenList *output = AllocTokenList();
+  int line_atom = InternAtom("__LINE__", strlen("__LINE__"));
+  DefineMacro(CreateToken(target_os_macro),
+              CreateMacroReplacement(NULL, Tokenize("1")));
+  compilation->num_of_conditionals = 0;
+  if (is_preprocess_only) BeginPreprocessedOutput(has_line_markers);
+  if (has_macro_stats) StartMacroStats();
+  struct Token *t;
+  while ((t = PeekToken())) {
+    if (compilation->macro_stats) UpdateMacroStats();
+    if (t->atom == line_atom) {
+      // __LINE__ in a macro is the line where the expansion began.
+      unsigned loc = GetExpansionOrigin();
+      NextToken();
+      char s[32];
+      snprintf(s, sizeof(s), "%d", GetSourceLine(loc));
+      struct Token line_token = *t;
+      line_token.type = kTokenDecimalNumber;
+      line_token.atom = 0;
+      line_token.length = strlen(s);
+      line_token.loc =
+          AddSourceBuffer(NULL, CopyStrToArena(s, line_token.length),
+                          line_token.length);
+      EmitPreprocessedToken(output, &line_token, loc);
       continue;
     }
-    if (IsEqualTokenWithCStr((t = PeekToken()), "#")) {
-      assert(t);
-      t = SkipDelimiterTokensInLogicalLine(t->next_token);
+    if (IsPunctToken(t, kPunctHash)) {
+      NextToken();
+      t = PeekTokenInLogicalLine();
       if (IsEqualTokenWithCStr(t, "define")) {
-        assert(t);
-        t = SkipDelimiterTokensInLogicalLine(t->next_token);
-        struct Node *from = t;
-        assert(t);
-        t = SkipDelimiterTokensInLogicalLine(t->next_token);
-        struct Node *args_token_head = NULL;
-        if (IsEqualTokenWithCStr(t, "(")) {
-          struct Node **args_token_last_holder = &args_token_head;
-          for (t = SkipDelimiterTokensInLogicalLine(t->next_token); t;
-               t = SkipDelimiterTokensInLogicalLine(t->next_token)) {
-            if (IsEqualTokenWithCStr(t, ")")) break;
-            *args_token_last_holder = DuplicateToken(t);
-            args_token_last_holder = &(*args_token_last_holder)->next_token;
-            t = SkipDelimiterTokensInLogicalLine(t->next_token);
-            if (!IsEqualTokenWithCStr(t, ",")) break;
-          }
-          if (!IsEqualTokenWithCStr(t, ")"))
-            ErrorWithToken(t, "Expected ) here");
-          // To distinguish function-like macro with zero args and
-          // token level replacement macro, add ) at the end of args
-          // to ensure args is not NULL
-          *args_token_last_holder = DuplicateToken(t);
-          t = SkipDelimiterTokensInLogicalLine(t->next_token);
-        }
-        // Token level replace case
-        assert(t);
-        struct Node *to_token_head = NULL;
-        struct Node **to_token_last_holder = &to_token_head;
-        while (t && !IsEqualTokenWithCStr(t, "\n")) {
-          *to_token_last_holder = DuplicateToken(t);
-          to_token_last_holder = &(*to_token_last_holder)->next_token;
-          t = t->next_token;
+        NextToken();
+        if (!IsTokenWithType(PeekTokenInLogicalLine(), kTokenIdent))
+          ErrorWithToken(t, "Expected macro name");
+        struct Token from = *NextToken();
+        struct TokenList *params = ReadMacroParams();
+        struct TokenList *body = AllocTokenList();
+        PeekTokenInLogicalLine();
+        while ((t = PeekToken()) && !IsEndOfLineToken(t)) {
+          PushTokenToList(body, NextToken());
         }
-        assert(IsEqualTokenWithCStr(t, "\n"));
-        RemoveTokensUpTo(t->next_token);
-        PushKeyValueToList(
-            replacement_list, CreateTokenStr(from),
-            CreateMacroReplacement(args_token_head, to_token_head));
+        assert(IsEndOfLineToken(t));
+        NextToken();
+        DefineMacro(&from, CreateMacroReplacement(params, body));
         continue;
       }
-      ErrorWithToken(NextToken(), "Not a valid macro");
-    }
-    if ((e = GetNodeByTokenKey(replacement_list, (t = PeekToken())))) {
-      assert(e->type == kNodeMacroReplacement);
-      struct Node *rep = DuplicateTokenSequence(e->value);
-      RemoveCurrentToken();
-      if (!e->arg_expr_list) {
-        // ident replace macro case
-        InsertTokens(rep);
+      if (IsEqualTokenWithCStr(t, "undef")) {
+        NextToken();
+        if (!IsTokenWithType(PeekTokenInLogicalLine(), kTokenIdent))
+          ErrorWithToken(t, "Expected macro name");
+        UndefineMacro(NextToken());
+        SkipToNextLine();
         continue;
       }
-      // function-like macro case
-      t = SkipDelimiterTokensInLogicalLine(t->next_token);
-      if (!IsEqualTokenWithCStr(t, "(")) ErrorWithToken(t, "Expected ( here");
-      t = t->next_token;
-      struct Node *it;
-      struct Node *arg_rep_list = AllocList();
-      for (it = e->arg_expr_list; it; it = it->next_token) {
-        if (IsEqualTokenWithCStr(it, ")")) break;
-        struct Node *arg_token_head = NULL;
-        struct Node **arg_token_last_holder = &arg_token_head;
-        t = SkipDelimiterTokensInLogicalLine(t);
-        for (; t; t = t->next_token) {
-          if (IsEqualTokenWithCStr(t, ")") || IsEqualTokenWithCStr(t, ","))
-            break;
-          *arg_token_last_holder = DuplicateToken(t);
-          arg_token_last_holder = &(*arg_token_last_holder)->next_token;
-        }
-        PushKeyValueToList(arg_rep_list, CreateTokenStr(it),
-                           CreateMacroReplacement(NULL, arg_token_head));
-        if (IsEqualTokenWithCStr(t, ")")) break;
-        t = t->next_token;
+      if (IsEqualTokenWithCStr(t, "include")) {
+        struct Token directive = *NextToken();
+        ReadInclude(&directive);
+        continue;
       }
-      if (!IsEqualTokenWithCStr(t, ")")) ErrorWithToken(t, "Expected ) here");
-      RemoveTokensUpTo(t->next_token);
-      // Insert & replace args
-      InsertTokensWithIdentReplace(rep, arg_rep_list);
-      continue;
+      if (IsEqualTokenWithCStr(t, "pragma")) {
+        // #pragma once is handled when the header is included again.
+        SkipToNextLine();
+        continue;
+      }
+      if (ReadConditionalDirective(t)) continue;
+      ErrorWithToken(NextToken(), "Not a valid macro");
     }
-    NextToken();
+    if (ExpandMacro(t)) continue;
+    unsigned origin_loc = GetExpansionOrigin();
+    EmitPreprocessedToken(output, NextToken(), origin_loc);
   }
+  if (compilation->num_of_conditionals)
+    ErrorWithToken(&compilation->conditionals[0].directive,
+                   "Unterminated conditional directive");
+  if (is_preprocess_only) EndPreprocessedOutput();
+  if (compilation->macro_stats) PrintMacroStats(is_macro_stats_json);
+  return output;
 }
 
-#define INITIAL_INPUT_SIZE 8192
-int main(int argc, char *argv[]) {
-  ParseCompilerArgs(argc, argv);
-  int buf_size = INITIAL_INPUT_SIZE;
-  char *input = malloc(buf_size);
-  int input_size = 0;
-  int c;
-  while ((c = getchar()) != EOF) {
-    input[input_size++] = c;
-    if (input_size == buf_size) {
-      buf_size <<= 1;
-      assert((input = realloc(input, buf_size)));
-    }
+static void CompileTokens(struct TokenList *tokens, const char *input) {
+  struct Node *ast = Parse(tokens);
+  if (compilation->dump) DumpAST(kDumpAST, ast);
+  struct SymbolEntry *symbols = Analyze(ast);
+  if (compilation->dump) {
+    DumpAST(kDumpTypedAST, ast);
+    DumpSymbols(symbols);
   }
-  assert(input_size < buf_size);
-  input[input_size] = 0;
+  if (emit_ast_path) EmitASTFile(emit_ast_path, ast, input);
+  Generate(ast);
+}
 
-  struct Node *tokens = Tokenize(input);
+void Compile(void) {
+  if (has_node_stats) StartNodeStats();
+  if (has_mem_report) StartMemReport();
+  StartDump();
+  // Without an input, the AST is loaded regardless of its source.
+  const char *input = NULL;
+  if (compilation->input_path || !load_ast_path) {
+    input = ReadInput(compilation->input_path);
+    AddDependency(compilation->input_path, input, strlen(input));
+  }
+  if (compilation->dump && input) DumpSourceTokens(input);
+  struct Node *ast = load_ast_path ? LoadASTFile(load_ast_path, input) : NULL;
+  if (ast) {
+    if (compilation->dump) DumpAST(kDumpTypedAST, ast);
+    Generate(ast);
+  } else {
+    LoadPrecompiledHeader();
+    struct TokenList *tokens = Preprocess(input);
+    if (compilation->dump) DumpPreprocessedTokens(tokens);
+    if (!is_preprocess_only) CompileTokens(tokens, input);
+  }
+  WriteDependencyFile();
+  // The memory report includes the node stats.
+  if (compilation->mem_report) {
+    PrintMemReport();
+  } else if (compilation->node_stats) {
+    PrintNodeStats();
+  }
+  if (compilation->dump) CloseDump();
+}
 
-  Preprocess(&tokens);
-  if (is_preprocess_only) {
-    OutputTokenSequenceAsCSource(tokens);
+int main(int argc, char *argv[]) {
+  ParseCompilerArgs(argc, argv);
+  if (is_benchmark_tokenizer) {
+    BenchmarkTokenizer(ReadInput(num_of_input_paths ? input_paths[0] : NULL));
     return 0;
   }
-
-  struct Node *ast = Parse(&tokens);
-  PrintASTNode(ast);
-  fputc('\n', stderr);
-
-  Analyze(ast);
-  PrintASTNode(ast);
-  fputc('\n', stderr);
-
-  Generate(ast);
+  if (emit_pch_path) {
+    if (num_of_input_paths != 1) Error("--emit-pch requires one header");
+    compilation->input_path = input_paths[0];
+    EmitPrecompiledHeader(emit_pch_path);
+    return 0;
+  }
+  if (load_ast_path && is_preprocess_only)
+    Error("--load-ast cannot be used with -E");
+  // The loaded AST has been analyzed, and its symbols are not kept.
+  if (load_ast_path &&
+      (IsDumpKindEnabled(kDumpPreprocessed) || IsDumpKindEnabled(kDumpAST) ||
+       IsDumpKindEnabled(kDumpSymbols)))
+    Error("--load-ast can dump only tokens and typed-ast");
+  const char *output_suffix = is_preprocess_only ? ".i" : ".S";
+  if (num_of_input_paths <= 1) {
+    // Single input is compiled on this thread and written to stdout, which
+    // can not be skipped.
+    if (skip_if_unchanged)
+      Error("--skip-if-unchanged requires multiple inputs");
+    compilation->input_path = num_of_input_paths ? input_paths[0] : NULL;
+    compilation->output = stdout;
+    // An AST file records the headers which its AST was made from.
+    compilation->records_dependencies = has_dependency_file || emit_ast_path;
+    if (has_dependency_file) {
+      if (!compilation->input_path) Error("-MD requires an input file");
+      compilation->dep_path =
+          dependency_file_path
+              ? dependency_file_path
+              : CreateOutputPath(compilation->input_path, ".d");
+      // The rule is for the file which would be written for multiple inputs.
+      compilation->dep_target =
+          CreateOutputPath(compilation->input_path, output_suffix);
+    }
+    Compile();
+    return 0;
+  }
+  if (dependency_file_path) Error("-MF requires a single input");
+  if (emit_ast_path || load_ast_path)
+    Error("--emit-ast and --load-ast require a single input");
+  // Otherwise, each foo.c is compiled into foo.S (or foo.i with -E).
+  if (!num_of_workers) num_of_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_of_workers <= 0) num_of_workers = 1;
+  CompileFilesInParallel(num_of_input_paths, input_paths, output_suffix,
+                         has_dependency_file ? ".d" : NULL, skip_if_unchanged,
+                         num_of_workers);
   return 0;
 }
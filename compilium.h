@@ -1,8 +1,16 @@
 #include "include/stdarg.h"
 #include "include/stdbool.h"
+#include "include/stddef.h"
 #include "include/stdio.h"
 #include "include/stdlib.h"
 #include "include/string.h"
+#include "include/time.h"
+#include "include/unistd.h"
+#include "include/fcntl.h"
+#include "include/sys/mman.h"
+#include "include/sys/resource.h"
+#include "include/sys/uio.h"
+#include "include/pthread.h"
 
 char *strndup(const char *s, size_t n);
 char *strdup(const char *s);
@@ -12,7 +20,6 @@ char *strdup(const char *s);
 
 enum NodeType {
   kNodeNone,
-  kNodeToken,
   kNodeStructMember,
   kNodeMacroReplacement,
   //
@@ -40,6 +47,7 @@ enum NodeType {
   kTypeAttrIdent,
   kTypeStruct,
   kTypeArray,
+  kNumOfNodeTypes,
 };
 
 enum TokenType {
@@ -61,91 +69,199 @@ enum TokenType {
   kTokenCharLiteral,
   kTokenStringLiteral,
   kTokenPunctuator,
-  kTokenLineComment,
-  kTokenBlockCommentBegin,
-  kTokenBlockCommentEnd,
+  kNumOfTokenTypes,
 };
 
-/*
-Node if-stmt:
-  stmt->cond = cond-expr
-  stmt->left = true-stmt
-  stmt->right = false-stmt or null
+enum PunctuatorType {
+  kPunctNone,
+  kPunctLBracket,
+  kPunctRBracket,
+  kPunctLParen,
+  kPunctRParen,
+  kPunctLBrace,
+  kPunctRBrace,
+  kPunctDot,
+  kPunctEllipsis,
+  kPunctArrow,
+  kPunctInc,
+  kPunctDec,
+  kPunctAmp,
+  kPunctStar,
+  kPunctPlus,
+  kPunctMinus,
+  kPunctTilde,
+  kPunctExcl,
+  kPunctSlash,
+  kPunctPercent,
+  kPunctLShift,
+  kPunctRShift,
+  kPunctLt,
+  kPunctGt,
+  kPunctLtEq,
+  kPunctGtEq,
+  kPunctEq,
+  kPunctNotEq,
+  kPunctCaret,
+  kPunctBar,
+  kPunctAmpAmp,
+  kPunctBarBar,
+  kPunctQuestion,
+  kPunctColon,
+  kPunctSemicolon,
+  kPunctAssign,
+  kPunctStarAssign,
+  kPunctSlashAssign,
+  kPunctPercentAssign,
+  kPunctPlusAssign,
+  kPunctMinusAssign,
+  kPunctLShiftAssign,
+  kPunctRShiftAssign,
+  kPunctAmpAssign,
+  kPunctCaretAssign,
+  kPunctBarAssign,
+  kPunctComma,
+  kPunctHash,
+  kPunctHashHash,
+  kNumOfPuncts,
+};
+#define PUNCT_SET(p) (1ULL << (p))
 
-Node func-call-expr:
-  expr->func_expr
-  expr->arg_expr_list
+// Tokens are compact records kept in contiguous TokenLists rather than Nodes.
+// AST nodes refer to the tokens they were built from.
+struct Token {
+  enum TokenType type;
+  int length;
+  unsigned loc;  // see source.c
+  int atom;  // for identifiers and keywords, 0 otherwise
+  enum PunctuatorType punct;  // for punctuators, kPunctNone otherwise
+};
 
-Node expr-stmt:
-  stmt->op = token(;)
-  stmt->left = node
-*/
+struct TokenList {
+  int size;
+  int capacity;
+  struct Token *tokens;
+};
+
+struct TokenSlice {
+  struct Token *begin;
+  struct Token *end;
+  unsigned origin_loc;  // where the expansion which inserted this began
+  bool is_expanded;  // true if macros in this are already expanded
+};
 
+// A node starts with the fields common to all types, followed by the fields
+// of its type in the union below. AllocNode allocates only the part of the
+// union used by the type, so a node must not touch fields of other types.
 struct Node {
   enum NodeType type;
   int reg;
   struct Node *expr_type;
-  struct Node *op;
-  struct Node *left;
-  struct Node *right;
-  struct Node *init;
-  struct Node *cond;
-  struct Node *updt;
-  struct Node *body;
-  struct Node *if_true_stmt;
-  struct Node *if_else_stmt;
-  struct Node *decltor_init_expr;
-  struct Node *decltor_init_stmt;
-  struct Node *struct_member_dict;
-  struct Node *struct_member_ent_type;
-  struct Node *struct_member_decl;
-  int struct_member_ent_ofs;
-  // for list
-  int capacity;
-  int size;
-  struct Node **nodes;
-  // for key value
-  const char *key;
-  struct Node *value;
-  // for local var
-  int byte_offset;
-  // for string literal
-  int label_number;
-  // kASTExprFuncCall
-  struct Node *func_expr;
-  struct Node *arg_expr_list;
-  struct Node *arg_var_list;
-  int stack_size_needed;
-  // kASTFuncDef
-  struct Node *func_body;
-  struct Node *func_type;
-  struct Node *func_name_token;
-  struct Node *tag;
-  struct Node *type_struct_spec;
-  struct Node *type_array_type_of;
-  struct Node *type_array_index_decl;
-  // kNodeToken
-  enum TokenType token_type;
-  struct Node *next_token;
-  const char *begin;
-  int length;
-  const char *src_str;
-  int line;
+  struct Token *op;
+  union {
+    // kASTExpr, kASTExprStmt, kASTJumpStmt, kASTSelectionStmt,
+    // kASTForStmt, kASTWhileStmt, kASTDirectDecltor, kASTDecltor, kASTDecl,
+    // kASTLocalVar, kTypeLValue, kTypePointer, kTypeFunction and
+    // kTypeAttrIdent
+    struct {
+      struct Node *left;
+      struct Node *right;
+      union {
+        // kASTExpr, kASTSelectionStmt, kASTForStmt, kASTWhileStmt and
+        // kASTLocalVar
+        struct {
+          struct Node *cond;
+          union {
+            // kASTExpr and kASTLocalVar
+            struct {
+              int byte_offset;
+              int label_number;  // for string literal
+            };
+            // kASTSelectionStmt
+            struct {
+              struct Node *if_true_stmt;
+              struct Node *if_else_stmt;
+            };
+            // kASTForStmt and kASTWhileStmt
+            struct {
+              struct Node *body;
+              struct Node *init;
+              struct Node *updt;
+            };
+          };
+        };
+        // kASTDirectDecltor
+        struct Node *decltor;  // of ( decltor )
+        // kASTDecltor
+        struct Node *decltor_init_expr;
+      };
+    };
+    // kASTExprFuncCall
+    struct {
+      struct Node *func_expr;
+      struct Node *arg_expr_list;
+      int stack_size_needed;
+    };
+    // kASTFuncDef
+    struct {
+      struct Node *func_body;
+      struct Node *func_type;
+      struct Token *func_name_token;
+      struct Node *arg_var_list;
+    };
+    // kASTList
+    struct {
+      int capacity;
+      int size;
+      struct Node **nodes;
+    };
+    // kASTKeyValue
+    struct {
+      const char *key;
+      int key_atom;  // 0 if the key is not an identifier
+      struct Node *value;
+    };
+    // kASTStructSpec and kTypeStruct
+    struct {
+      struct Token *tag;
+      union {
+        struct Node *struct_member_dict;  // kASTStructSpec
+        struct Node *type_struct_spec;  // kTypeStruct
+      };
+    };
+    // kNodeStructMember
+    struct {
+      struct Node *struct_member_decl;
+      struct Node *struct_member_ent_type;
+      int struct_member_ent_ofs;
+    };
+    // kTypeArray
+    struct {
+      struct Node *type_array_type_of;
+      struct Node *type_array_index_decl;
+    };
+    // kNodeMacroReplacement
+    struct {
+      struct TokenList *macro_params;  // NULL for object-like macros
+      struct TokenList *macro_body;
+    };
+  };
 };
 
 _Noreturn void Error(const char *fmt, ...);
 _Noreturn void __assert(const char *expr_str, const char *file, int line);
 
-void PrintTokenLine(struct Node *t);
-_Noreturn void ErrorWithToken(struct Node *t, const char *fmt, ...);
+void PrintTokenLine(struct Token *t);
+_Noreturn void ErrorWithToken(struct Token *t, const char *fmt, ...);
 
 void PushToList(struct Node *list, struct Node *node);
 void PushKeyValueToList(struct Node *list, const char *key, struct Node *value);
+void PushTokenKeyValueToList(struct Node *list, struct Token *key,
+                             struct Node *value);
 
 struct Node *AllocList();
 int GetSizeOfList(struct Node *list);
 struct Node *GetNodeAt(struct Node *list, int index);
-struct Node *GetNodeByTokenKey(struct Node *list, struct Node *key);
+struct Node *GetNodeByTokenKey(struct Node *list, struct Token *key);
 
 extern const char *symbol_prefix;
 
@@ -159,25 +275,140 @@ extern const char *param_reg_names_64[NUM_OF_PARAM_REGISTERS];
 extern const char *param_reg_names_32[NUM_OF_PARAM_REGISTERS];
 extern const char *param_reg_names_8[NUM_OF_PARAM_REGISTERS];
 
+// Tokens lexed on demand stay valid while this many tokens are read after them.
+#define TOKEN_LOOKAHEAD_SIZE 16
+
+// Allocation sites counted by --mem-report
+enum MemSite {
+  kMemSiteAllocNode,
+  kMemSiteAllocToken,
+  kMemSiteAllocTokenList,
+  kMemSiteExpandTokenList,
+  kMemSiteExpandList,
+  kMemSiteAllocTokenChunk,
+  kMemSiteCopyStr,
+  kMemSiteAllocSymbolEntry,
+  kMemSiteBuildLineIndex,
+  kNumOfMemSites,
+};
+
+struct Arena {
+  struct ArenaChunk *chunks;
+  struct ArenaChunk *current;  // NULL if no chunk is used yet
+};
+
+// State of a single translation unit. Each thread compiles one unit at a time
+// and points `compilation` at its state while doing so.
+struct CompilationContext {
+  const char *input_path;  // NULL for stdin
+  const char *output_path;
+  off_t input_size;
+  FILE *output;
+  struct Arena arena;  // see arena.c
+  // @depfile.c
+  const char *dep_path;  // NULL if no dependency file is written
+  const char *dep_target;
+  bool records_dependencies;  // for a dependency file or an AST file
+  struct Dependency *dependencies;
+  int num_of_dependencies;
+  int dependencies_capacity;
+  // @source.c
+  struct SourceBuffer *source_buffers;
+  int num_of_source_buffers;
+  int source_buffers_capacity;
+  unsigned next_source_loc;
+  int last_source_buffer_index;
+  // @ast.c
+  struct NodeStats *node_stats;  // NULL without --node-stats
+  // @atom.c
+  struct Atom *atoms;
+  int num_of_atoms;
+  int atoms_capacity;
+  int *atom_hash_table;
+  int atom_hash_table_size;
+  // @compilium.c
+  struct Conditional *conditionals;  // of #if, the innermost last
+  int num_of_conditionals;
+  int conditionals_capacity;
+  struct TokenSlice *macro_args;  // reused by each function-like macro call
+  int macro_args_capacity;
+  // @dump.c
+  FILE *dump;  // NULL without --dump
+  // @include.c
+  struct IncludedHeader *included_headers;  // indexed by id of headers
+  int included_headers_capacity;
+  // @macro.c
+  struct MacroEntry *macro_table;
+  int macro_table_size;
+  int num_of_macros;
+  int macro_generation;  // incremented by each #define and #undef
+  int *macro_dependency_atoms;  // of the expansion being made
+  int num_of_macro_dependency_atoms;
+  int macro_dependency_atoms_capacity;
+  struct InnerMacroExpansion *inner_macro_expansions;  // for --macro-stats
+  int num_of_inner_macro_expansions;
+  int inner_macro_expansions_capacity;
+  // @macrostats.c
+  struct MacroStatsContext *macro_stats;  // NULL without --macro-stats
+  // @memreport.c
+  struct MemReport *mem_report;  // NULL without --mem-report
+  // @token.c
+  struct TokenList *token_stream;  // NULL while lexing from lexer_cursor
+  int token_stream_pos;
+  const char *lexer_cursor;
+  const char *lexer_end;
+  unsigned lexer_loc;  // location of lexer_cursor
+  struct LexerInput *lexer_inputs;  // inputs to resume, last first
+  int num_of_lexer_inputs;
+  int lexer_inputs_capacity;
+  struct Token lookahead_tokens[TOKEN_LOOKAHEAD_SIZE];
+  int lookahead_index;
+  bool has_lookahead;
+  struct TokenSlice *token_slices;  // read before token_stream, last first
+  int num_of_token_slices;
+  int token_slices_capacity;
+  struct TokenChunk *token_pool;
+  struct TokenChunk *current_token_chunk;
+  // @pch.c
+  struct SymbolEntry *prelude_symbols;  // declared by --include-pch
+  // @ppoutput.c
+  struct PPOutput *pp_output;  // writer of -E output
+  // @analyzer.c
+  int reg_used_table[NUM_OF_SCRATCH_REGS + 1];
+  struct Node *reg_node_table[NUM_OF_SCRATCH_REGS + 1];
+  // @generator.c
+  struct Node *str_list;
+  int label_number;
+};
+extern _Thread_local struct CompilationContext *compilation;
+
+// @compilium.c
+struct TokenList *Preprocess(const char *input);
+void Compile(void);
+
 // @analyzer.c
-void Analyze(struct Node *node);
+struct SymbolEntry *Analyze(struct Node *ast);
+
+// @arena.c
+void *AllocFromArena(size_t size);
+char *CopyStrToArena(const char *s, int length);
+void ResetArena(struct Arena *a);
+void GetArenaUsage(struct Arena *a, size_t *used, size_t *reserved);
 
 // @ast.c
-bool IsToken(struct Node *n);
-bool IsTokenWithType(struct Node *n, enum TokenType type);
 struct Node *AllocNode(enum NodeType type);
-struct Node *CreateASTBinOp(struct Node *t, struct Node *left,
+struct Node *CreateASTBinOp(struct Token *t, struct Node *left,
                             struct Node *right);
-struct Node *CreateASTUnaryPrefixOp(struct Node *t, struct Node *right);
-struct Node *CreateASTUnaryPostfixOp(struct Node *left, struct Node *t);
-struct Node *CreateASTExprStmt(struct Node *t, struct Node *left);
+struct Node *CreateASTUnaryPrefixOp(struct Token *t, struct Node *right);
+struct Node *CreateASTUnaryPostfixOp(struct Node *left, struct Token *t);
+struct Node *CreateASTExprStmt(struct Token *t, struct Node *left);
 struct Node *CreateASTFuncDef(struct Node *func_decl, struct Node *func_body);
 
 struct Node *CreateASTKeyValue(const char *key, struct Node *value);
 
 struct Node *CreateASTLocalVar(int byte_offset, struct Node *var_type);
 
-struct Node *CreateTypeBase(struct Node *t);
+struct Node *CreateTypeBase(struct Token *t);
 
 struct Node *CreateTypeLValue(struct Node *type);
 
@@ -185,28 +416,124 @@ struct Node *CreateTypePointer(struct Node *type);
 struct Node *CreateTypeFunction(struct Node *return_type,
                                 struct Node *arg_type_list);
 struct Node *GetArgTypeList(struct Node *func_type);
-struct Node *CreateTypeStruct(struct Node *tag_token, struct Node *struct_spec);
-struct Node *CreateTypeAttrIdent(struct Node *ident_token, struct Node *type);
-struct Node *CreateASTIdent(struct Node *ident);
+struct Node *CreateTypeStruct(struct Token *tag_token,
+                              struct Node *struct_spec);
+struct Node *CreateTypeAttrIdent(struct Token *ident_token, struct Node *type);
+struct Node *CreateASTIdent(struct Token *ident);
 struct Node *CreateTypeArray(struct Node *type_of, struct Node *index_decl);
-struct Node *CreateMacroReplacement(struct Node *args_tokens,
-                                    struct Node *to_tokens);
+struct Node *CreateMacroReplacement(struct TokenList *params,
+                                    struct TokenList *body);
+const char *GetNodeTypeName(enum NodeType type);
 void PrintASTNode(struct Node *n);
+void PrintASTNodeToFile(struct Node *n, FILE *fp);
+void PrintASTNodeAsJSON(struct Node *n, FILE *fp);
+void StartNodeStats(void);
+void PrintNodeStats(void);
+
+// @atom.c
+int InternAtom(const char *s, int length);
+const char *GetAtomStr(int atom);
+
+// @depfile.c
+unsigned long long HashContents(const char *p, int size);
+void AddOutputOption(const char *option);
+unsigned long long GetOutputOptionsHash(void);
+void AddDependency(const char *path, const char *contents, int size);
+const char *GetDependency(int index, int *size, unsigned long long *hash);
+bool IsFileUnchanged(const char *path, int size, unsigned long long hash);
+void WriteDependencyFile(void);
+bool IsOutputUpToDate(const char *output_path, const char *dep_path);
+
+// @driver.c
+const char *ReadInput(const char *path);
+const char *CreateOutputPath(const char *input_path, const char *suffix);
+void CompileFilesInParallel(int num_of_inputs, const char **input_paths,
+                            const char *output_suffix, const char *dep_suffix,
+                            bool skip_if_unchanged, int num_of_workers);
+
+// @dump.c
+enum DumpKind {
+  kDumpTokens,
+  kDumpPreprocessed,
+  kDumpAST,
+  kDumpTypedAST,
+  kDumpSymbols,
+  kNumOfDumpKinds,
+};
+void AddDumpKinds(const char *kinds);
+bool IsDumpKindEnabled(enum DumpKind kind);
+void SetDumpFormat(const char *format);
+void PrintJSONString(FILE *fp, const char *s, int length);
+void StartDump(void);
+void CloseDump(void);
+void DumpSourceTokens(const char *input);
+void DumpPreprocessedTokens(struct TokenList *tokens);
+void DumpAST(enum DumpKind kind, struct Node *ast);
+void DumpSymbols(struct SymbolEntry *symbols);
 
 // @generate.c
 void Generate(struct Node *ast);
 
+// @include.c
+void AddIncludeDir(const char *dir);
+void IncludeHeader(struct Token *directive, const char *name, int name_length,
+                   bool is_quoted);
+
+// @macro.c
+void DefineMacro(struct Token *name, struct Node *replacement);
+void UndefineMacro(struct Token *name);
+struct Node *FindMacro(struct Token *name);
+struct Node *GetMacroInSlot(int slot, int *atom);
+struct TokenList *GetExpandedMacroBody(struct Token *name);
+
+// @macrostats.c
+void StartMacroStats(void);
+void UpdateMacroStats(void);
+void BeginMacroStats(struct Token *macro_name);
+void CountMacroStatsToken(void);
+void CountMacroStatsInnerExpansion(int atom, int depth, int num_of_tokens);
+void PrintMacroStats(bool is_json);
+
+// @memreport.c
+void StartMemReport(void);
+void CountMemReportAlloc(enum MemSite site, size_t size);
+void CountMemReportToken(struct Token *t);
+void PrintMemReport(void);
+
 // @parser.c
 extern struct Node *toplevel_names;
-void InitParser(struct Node **);
-struct Node *Parse(struct Node **passed_tokens);
+void InitParser(struct TokenList *tokens);
+struct Node *Parse(struct TokenList *tokens);
+
+// @pch.c
+void EmitPrecompiledHeader(const char *path);
+void MapPrecompiledHeader(const char *path);
+void LoadPrecompiledHeader(void);
+void EmitASTFile(const char *path, struct Node *ast, const char *input);
+struct Node *LoadASTFile(const char *path, const char *input);
+
+// @ppexpr.c
+long EvalPreprocessorExpr(struct TokenList *tokens);
+
+// @ppoutput.c
+void BeginPreprocessedOutput(bool has_line_markers);
+void WritePreprocessedToken(struct Token *t, unsigned origin_loc);
+void EndPreprocessedOutput(void);
+
+// @source.c
+unsigned AddSourceBuffer(const char *path, const char *begin, int size);
+const char *GetSourceText(unsigned loc);
+const char *GetSourcePath(unsigned loc);
+int GetSourceLine(unsigned loc);
+const char *GetSourceLineBegin(unsigned loc);
 
 // @struct.c
 struct SymbolEntry;
 int CalcStructSize(struct Node *spec);
 int CalcStructAlign(struct Node *spec);
 void AddMemberOfStructFromDecl(struct Node *struct_spec, struct Node *decl);
-struct Node *FindStructMember(struct Node *struct_type, struct Node *key_token);
+struct Node *FindStructMember(struct Node *struct_type,
+                              struct Token *key_token);
 void ResolveTypesOfMembersOfStruct(struct SymbolEntry *ctx, struct Node *spec);
 
 // @symbol.c
@@ -217,57 +544,75 @@ enum SymbolType {
   kSymbolStructType,
 };
 struct SymbolEntry;
+enum SymbolType GetSymbolType(struct SymbolEntry *e);
+struct SymbolEntry *GetPrevSymbol(struct SymbolEntry *e);
+int GetSymbolAtom(struct SymbolEntry *e);
+struct Node *GetSymbolValue(struct SymbolEntry *e);
 int GetLastLocalVarOffset(struct SymbolEntry *);
-struct Node *AddLocalVar(struct SymbolEntry **ctx, const char *key,
+struct Node *AddLocalVar(struct SymbolEntry **ctx, struct Token *key_token,
                          struct Node *var_type);
-struct Node *FindLocalVar(struct SymbolEntry *e, struct Node *key_token);
-void AddFuncDef(struct SymbolEntry **ctx, const char *key,
+struct Node *FindLocalVar(struct SymbolEntry *e, struct Token *key_token);
+void AddFuncDef(struct SymbolEntry **ctx, struct Token *key_token,
                 struct Node *func_def);
-struct Node *FindFuncDef(struct SymbolEntry *e, struct Node *key_token);
-void AddFuncDeclType(struct SymbolEntry **ctx, const char *key,
+struct Node *FindFuncDef(struct SymbolEntry *e, struct Token *key_token);
+void AddFuncDeclType(struct SymbolEntry **ctx, struct Token *key_token,
                      struct Node *func_decl);
-struct Node *FindFuncDeclType(struct SymbolEntry *e, struct Node *key_token);
-void AddStructType(struct SymbolEntry **, const char *, struct Node *);
-struct Node *FindStructType(struct SymbolEntry *, struct Node *);
+struct Node *FindFuncDeclType(struct SymbolEntry *e, struct Token *key_token);
+void AddStructType(struct SymbolEntry **, struct Token *, struct Node *);
+struct Node *FindStructType(struct SymbolEntry *, struct Token *);
 
 // @token.c
-bool IsToken(struct Node *n);
-struct Node *AllocToken(const char *src_str, int line, const char *begin,
-                        int length, enum TokenType type);
-struct Node *DuplicateToken(struct Node *base_token);
-struct Node *DuplicateTokenSequence(struct Node *base_head);
-const char *CreateTokenStr(struct Node *t);
-int IsEqualTokenWithCStr(struct Node *t, const char *s);
-void PrintTokenSequence(struct Node *t);
-void OutputTokenSequenceAsCSource(struct Node *t);
-void PrintToken(struct Node *t);
-void PrintTokenBrief(struct Node *t);
-void PrintTokenStrToFile(struct Node *t, FILE *fp);
-
-void InitTokenStream(struct Node **head_token);
-struct Node *PeekToken(void);
-struct Node *ReadToken(enum TokenType type);
-struct Node *ConsumeToken(enum TokenType type);
-struct Node *ConsumeTokenStr(const char *s);
-struct Node *ExpectTokenStr(const char *s);
-struct Node *ConsumePunctuator(const char *s);
-struct Node *ExpectPunctuator(const char *s);
-struct Node *NextToken(void);
-void RemoveCurrentToken(void);
-void RemoveTokensUpTo(struct Node *end);
-void InsertTokens(struct Node *);
-void InsertTokensWithIdentReplace(struct Node *seq, struct Node *rep_list);
-struct Node **RemoveDelimiterTokens(struct Node **);
+bool IsTokenWithType(struct Token *t, enum TokenType type);
+struct Token *AllocToken(void);
+struct TokenList *AllocTokenList(void);
+struct Token *PushTokenToList(struct TokenList *list, struct Token *t);
+const char *CreateTokenStr(struct Token *t);
+const char *GetTokenBegin(struct Token *t);
+int IsEqualTokenWithCStr(struct Token *t, const char *s);
+bool IsEndOfLineToken(struct Token *t);
+const char *GetTokenTypeName(enum TokenType type);
+void PrintTokenList(struct TokenList *list, FILE *fp);
+void PrintToken(struct Token *t);
+void PrintTokenBrief(struct Token *t, FILE *fp);
+void PrintTokenStrToFile(struct Token *t, FILE *fp);
+
+void InitTokenStream(struct TokenList *tokens);
+void InitTokenStreamFromInput(const char *input, const char *path);
+void PushLexerInput(const char *begin, const char *end, unsigned loc);
+void SkipInactiveGroup(void);
+struct Token *PeekToken(void);
+struct Token *ConsumeToken(enum TokenType type);
+struct Token *ConsumeTokenStr(const char *s);
+struct Token *ExpectTokenStr(const char *s);
+bool IsPunctToken(struct Token *t, enum PunctuatorType punct);
+struct Token *ConsumePunct(enum PunctuatorType punct);
+struct Token *ConsumePunctInSet(unsigned long long punct_set);
+struct Token *ExpectPunct(enum PunctuatorType punct);
+struct Token *NextToken(void);
+void RecycleTokenPool(void);
+void BeginTokenSlice(struct TokenSlice *s);
+void AppendTokenToSlice(struct TokenSlice *s, struct Token *t);
+unsigned GetExpansionOrigin(void);
+void InsertTokens(struct TokenList *seq, unsigned origin_loc);
+void InsertExpandedTokens(struct TokenList *seq, unsigned origin_loc);
+bool IsNextTokenExpanded(void);
+void InsertTokensWithArgs(struct TokenList *body, struct TokenList *params,
+                          struct TokenSlice *args, unsigned origin_loc);
+struct TokenList *RemoveDelimiterTokens(struct TokenList *tokens);
 
 // @tokenizer.c
-struct Node *CreateToken(const char *input);
-struct Node *Tokenize(const char *input);
+struct Token *CreateToken(const char *input);
+struct Token *LexToken(struct Token *t, const char **p, unsigned *loc);
+struct TokenList *Tokenize(const char *input);
+const char *SkipConditionalGroup(const char *p, const char *end);
+const char *GetPunctuatorStr(enum PunctuatorType punct);
+void BenchmarkTokenizer(const char *input);
 
 // @type.c
 int IsSameTypeExceptAttr(struct Node *a, struct Node *b);
 int IsLValueType(struct Node *t);
 struct Node *GetTypeWithoutAttr(struct Node *t);
-struct Node *GetIdentifierTokenFromTypeAttr(struct Node *t);
+struct Token *GetIdentifierTokenFromTypeAttr(struct Node *t);
 struct Node *GetRValueType(struct Node *t);
 int GetSizeOfType(struct Node *t);
 int GetAlignOfType(struct Node *t);
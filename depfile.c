@@ -0,0 +1,213 @@
+#include "compilium.h"
+
+// Dependency files (-MD, -MF) list the source and every header read by a
+// compilation as a make rule. Each file is also recorded with its size and a
+// hash of its contents on a line which make ignores as a comment, after a hash
+// of the options which shape the output:
+//
+//   foo.S: foo.c foo.h
+//   # options 89ab0123cdef4567
+//   # dependency 3f1c0d5e9a7b2468 1234 foo.c
+//   # dependency 0123456789abcdef 56 foo.h
+//
+// With --skip-if-unchanged, a compilation is skipped if its output exists, it
+// was written with the same options, and every recorded file still has the
+// same size and hash, which costs a read of each file instead of a compilation.
+
+#define OPTIONS_LINE_PREFIX "# options "
+#define DEPENDENCY_LINE_PREFIX "# dependency "
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+
+// Options are given before any compilation starts, so the hash is shared.
+static unsigned long long options_hash = FNV_OFFSET_BASIS;
+
+struct Dependency {
+  const char *path;
+  int size;
+  unsigned long long hash;
+};
+
+static unsigned long long AddToHash(unsigned long long hash, const char *p,
+                                    int size) {
+  // FNV-1a
+  for (int i = 0; i < size; i++) {
+    hash ^= (unsigned char)p[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+unsigned long long HashContents(const char *p, int size) {
+  return AddToHash(FNV_OFFSET_BASIS, p, size);
+}
+
+void AddOutputOption(const char *option) {
+  // option is an argument which changes the output, such as --target-os and
+  // its value. The terminating NUL keeps "-Ia" "b" apart from "-Iab".
+  options_hash = AddToHash(options_hash, option, strlen(option) + 1);
+}
+
+unsigned long long GetOutputOptionsHash(void) { return options_hash; }
+
+void AddDependency(const char *path, const char *contents, int size) {
+  // does nothing unless dependencies are recorded for this compilation.
+  if (!compilation->records_dependencies) return;
+  if (compilation->num_of_dependencies >= compilation->dependencies_capacity) {
+    compilation->dependencies_capacity =
+        (compilation->dependencies_capacity + 1) * 2;
+    compilation->dependencies =
+        realloc(compilation->dependencies,
+                sizeof(struct Dependency) * compilation->dependencies_capacity);
+    assert(compilation->dependencies);
+  }
+  struct Dependency *d =
+      &compilation->dependencies[compilation->num_of_dependencies++];
+  d->path = path;
+  d->size = size;
+  d->hash = HashContents(contents, size);
+}
+
+const char *GetDependency(int index, int *size, unsigned long long *hash) {
+  // returns the path of the index-th dependency recorded by AddDependency.
+  struct Dependency *d = &compilation->dependencies[index];
+  *size = d->size;
+  *hash = d->hash;
+  return d->path;
+}
+
+static void WriteMakePath(FILE *fp, const char *path) {
+  for (const char *p = path; *p; p++) {
+    if (*p == ' ' || *p == '#') fputc('\\', fp);
+    if (*p == '$') fputc('$', fp);
+    fputc(*p, fp);
+  }
+}
+
+void WriteDependencyFile(void) {
+  if (!compilation->dep_path) return;
+  FILE *fp = fopen(compilation->dep_path, "w");
+  if (!fp) Error("Failed to open %s", compilation->dep_path);
+  WriteMakePath(fp, compilation->dep_target);
+  fputc(':', fp);
+  for (int i = 0; i < compilation->num_of_dependencies; i++) {
+    fputc(' ', fp);
+    WriteMakePath(fp, compilation->dependencies[i].path);
+  }
+  fputc('\n', fp);
+  fprintf(fp, OPTIONS_LINE_PREFIX "%016llx\n", options_hash);
+  for (int i = 0; i < compilation->num_of_dependencies; i++) {
+    struct Dependency *d = &compilation->dependencies[i];
+    fprintf(fp, DEPENDENCY_LINE_PREFIX "%016llx %d %s\n", d->hash, d->size,
+            d->path);
+  }
+  fclose(fp);
+}
+
+static const char *MapFile(const char *path, int *size) {
+  // returns a read-only mapping of path, or NULL if it cannot be read.
+  // An empty file is returned as "", since it cannot be mapped.
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  off_t file_size = lseek(fd, 0, SEEK_END);
+  const char *p = "";
+  if (file_size > 0)
+    p = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file_size < 0 || p == MAP_FAILED) return NULL;
+  *size = file_size;
+  return p;
+}
+
+static void UnmapFile(const char *p, int size) {
+  if (size) munmap((void *)p, size);
+}
+
+static const char *ParseNumber(const char *p, const char *end, int base,
+                               unsigned long long *value) {
+  // returns the end of the number at p, which is followed by a space or end,
+  // or NULL if it has no digits, too many digits or other characters.
+  const char *begin = p;
+  *value = 0;
+  for (; p < end && *p != ' '; p++) {
+    int digit = base;
+    if ('0' <= *p && *p <= '9') digit = *p - '0';
+    if ('a' <= *p && *p <= 'f') digit = *p - 'a' + 10;
+    if (digit >= base || p - begin >= 16) return NULL;
+    *value = *value * base + digit;
+  }
+  return p > begin ? p : NULL;
+}
+
+bool IsFileUnchanged(const char *path, int size, unsigned long long hash) {
+  // returns true if path still has the size and the hash of its contents.
+  int current_size;
+  const char *contents = MapFile(path, &current_size);
+  if (!contents) return false;
+  // The contents are read only if the size is the same.
+  bool is_unchanged =
+      current_size == size && HashContents(contents, current_size) == hash;
+  UnmapFile(contents, current_size);
+  return is_unchanged;
+}
+
+static bool IsDependencyUnchanged(const char *line, const char *end) {
+  // line is the rest of a dependency line after its prefix.
+  unsigned long long hash, size;
+  const char *p = ParseNumber(line, end, 16, &hash);
+  if (!p || p == end) return false;
+  p = ParseNumber(p + 1, end, 10, &size);
+  if (!p || p == end || ++p == end || size > 0x7fffffff) return false;
+  char *path = strndup(p, end - p);
+  bool is_unchanged = IsFileUnchanged(path, size, hash);
+  free(path);
+  return is_unchanged;
+}
+
+static bool IsDependencyFileUpToDate(const char *s, const char *s_end,
+                                     const char *output_path) {
+  // The rule should be for output_path, not for another kind of output.
+  // Paths escaped in the rule never match, so they are always compiled.
+  int output_path_length = strlen(output_path);
+  if (s_end - s <= output_path_length ||
+      strncmp(s, output_path, output_path_length) != 0 ||
+      s[output_path_length] != ':')
+    return false;
+  const char *p = memchr(s, '\n', s_end - s);
+  if (!p) return false;
+  // The options are checked first, since they make every dependency stale.
+  int options_prefix_length = strlen(OPTIONS_LINE_PREFIX);
+  p++;
+  const char *end = memchr(p, '\n', s_end - p);
+  unsigned long long hash;
+  if (!end || end - p <= options_prefix_length ||
+      strncmp(p, OPTIONS_LINE_PREFIX, options_prefix_length) != 0 ||
+      ParseNumber(p + options_prefix_length, end, 16, &hash) != end ||
+      hash != options_hash)
+    return false;
+  int num_of_dependencies = 0;
+  int prefix_length = strlen(DEPENDENCY_LINE_PREFIX);
+  for (p = end + 1; p < s_end; p = end + 1) {
+    end = memchr(p, '\n', s_end - p);
+    if (!end) end = s_end;
+    if (end - p >= prefix_length &&
+        strncmp(p, DEPENDENCY_LINE_PREFIX, prefix_length) == 0) {
+      if (!IsDependencyUnchanged(p + prefix_length, end)) return false;
+      num_of_dependencies++;
+    }
+  }
+  return num_of_dependencies > 0;
+}
+
+bool IsOutputUpToDate(const char *output_path, const char *dep_path) {
+  // returns true if output_path was written with the current options from the
+  // files recorded in dep_path and none of them has changed since then.
+  int fd = open(output_path, O_RDONLY);
+  if (fd < 0) return false;
+  close(fd);
+  int size;
+  const char *s = MapFile(dep_path, &size);
+  if (!s) return false;
+  bool is_up_to_date = IsDependencyFileUpToDate(s, s + size, output_path);
+  UnmapFile(s, size);
+  return is_up_to_date;
+}
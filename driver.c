@@ -0,0 +1,208 @@
+#include "compilium.h"
+
+static struct CompilationContext main_compilation;
+_Thread_local struct CompilationContext *compilation = &main_compilation;
+
+// Input
+
+#define INPUT_READ_BLOCK_SIZE (64 * 1024)
+static char *ReadAllFromFd(int fd) {
+  // returns NUL-terminated contents read until EOF.
+  int buf_size = INPUT_READ_BLOCK_SIZE;
+  char *input = malloc(buf_size);
+  int input_size = 0;
+  for (;;) {
+    if (buf_size - input_size < INPUT_READ_BLOCK_SIZE) {
+      buf_size <<= 1;
+      assert((input = realloc(input, buf_size)));
+    }
+    ssize_t read_size = read(fd, input + input_size, buf_size - input_size - 1);
+    if (read_size < 0) Error("Failed to read input");
+    if (read_size == 0) break;
+    input_size += read_size;
+  }
+  assert(input_size < buf_size);
+  input[input_size] = 0;
+  return input;
+}
+
+static const char *ReadInputFromFile(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) Error("Failed to open %s", path);
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size < 0) Error("Failed to get size of %s", path);
+  // Tokens point directly into the input, so a read-only mapping of the file
+  // can be tokenized without copying. mmap fills the rest of the last page with
+  // zeros, which terminates the input unless the file ends on a page boundary.
+  if (size % getpagesize()) {
+    const char *input = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (input != MAP_FAILED) {
+      close(fd);
+      return input;
+    }
+  }
+  if (lseek(fd, 0, SEEK_SET) < 0) Error("Failed to rewind %s", path);
+  const char *input = ReadAllFromFd(fd);
+  close(fd);
+  return input;
+}
+
+const char *ReadInput(const char *path) {
+  // reads stdin if path is NULL.
+  return path ? ReadInputFromFile(path) : ReadAllFromFd(0);
+}
+
+static off_t GetFileSize(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) Error("Failed to open %s", path);
+  off_t size = lseek(fd, 0, SEEK_END);
+  close(fd);
+  if (size < 0) Error("Failed to get size of %s", path);
+  return size;
+}
+
+const char *CreateOutputPath(const char *input_path, const char *suffix) {
+  // foo.c -> foo<suffix>, foo -> foo<suffix>
+  int base_len = strlen(input_path);
+  if (base_len >= 2 && strcmp(&input_path[base_len - 2], ".c") == 0)
+    base_len -= 2;
+  int path_size = base_len + strlen(suffix) + 1;
+  char *path = malloc(path_size);
+  snprintf(path, path_size, "%.*s%s", base_len, input_path, suffix);
+  return path;
+}
+
+// Work-stealing scheduler
+//
+// Jobs are distributed over per-worker queues ahead of time, largest input
+// first, each to the least loaded queue. A worker pops jobs from the head of
+// its own queue and, once that is empty, steals from the tail of the others.
+// No jobs are added after startup, so a worker exits as soon as all queues are
+// observed empty.
+
+struct WorkQueue {
+  int lock;
+  int head;
+  int tail;
+  off_t load;
+  struct CompilationContext **jobs;
+};
+
+static struct WorkQueue *work_queues;
+static int num_of_work_queues;
+static bool skips_unchanged_jobs;
+
+static void LockWorkQueue(struct WorkQueue *q) {
+  while (__atomic_exchange_n(&q->lock, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+static void UnlockWorkQueue(struct WorkQueue *q) {
+  __atomic_store_n(&q->lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct CompilationContext *PopJob(struct WorkQueue *q) {
+  LockWorkQueue(q);
+  struct CompilationContext *job = NULL;
+  if (q->head < q->tail) job = q->jobs[q->head++];
+  UnlockWorkQueue(q);
+  return job;
+}
+
+static struct CompilationContext *StealJob(struct WorkQueue *q) {
+  LockWorkQueue(q);
+  struct CompilationContext *job = NULL;
+  if (q->head < q->tail) job = q->jobs[--q->tail];
+  UnlockWorkQueue(q);
+  return job;
+}
+
+static void RunJob(struct CompilationContext *job, struct Arena *arena) {
+  // arena is lent to the job, and reset for the next job after it is done.
+  if (skips_unchanged_jobs && IsOutputUpToDate(job->output_path, job->dep_path))
+    return;
+  compilation = job;
+  job->arena = *arena;
+  // The output is truncated before it is written, so the dependency file of
+  // the last output is removed first. Otherwise, the output left by a failed
+  // compilation would be taken as up to date once its inputs are reverted.
+  if (job->dep_path) unlink(job->dep_path);
+  job->output = fopen(job->output_path, "w");
+  if (!job->output) Error("Failed to open %s", job->output_path);
+  Compile();
+  fclose(job->output);
+  *arena = job->arena;
+  ResetArena(arena);
+  compilation = &main_compilation;
+}
+
+static void *WorkerMain(void *arg) {
+  struct WorkQueue *own_queue = arg;
+  int own_index = own_queue - work_queues;
+  struct Arena arena = {NULL, NULL};
+  for (;;) {
+    struct CompilationContext *job = PopJob(own_queue);
+    for (int i = 1; !job && i < num_of_work_queues; i++) {
+      job = StealJob(&work_queues[(own_index + i) % num_of_work_queues]);
+    }
+    if (!job) return NULL;
+    RunJob(job, &arena);
+  }
+}
+
+static int CompareJobsByInputSizeDesc(const void *a, const void *b) {
+  const struct CompilationContext *ja = *(struct CompilationContext **)a;
+  const struct CompilationContext *jb = *(struct CompilationContext **)b;
+  if (ja->input_size == jb->input_size) return 0;
+  return ja->input_size < jb->input_size ? 1 : -1;
+}
+
+void CompileFilesInParallel(int num_of_inputs, const char **input_paths,
+                            const char *output_suffix, const char *dep_suffix,
+                            bool skip_if_unchanged, int num_of_workers) {
+  // dep_suffix is NULL if no dependency files are written. skip_if_unchanged
+  // requires dependency files.
+  assert(num_of_workers >= 1);
+  assert(dep_suffix || !skip_if_unchanged);
+  skips_unchanged_jobs = skip_if_unchanged;
+  if (num_of_workers > num_of_inputs) num_of_workers = num_of_inputs;
+  struct CompilationContext **jobs =
+      calloc(num_of_inputs, sizeof(struct CompilationContext *));
+  for (int i = 0; i < num_of_inputs; i++) {
+    jobs[i] = calloc(1, sizeof(struct CompilationContext));
+    jobs[i]->input_path = input_paths[i];
+    jobs[i]->input_size = GetFileSize(input_paths[i]);
+    jobs[i]->output_path = CreateOutputPath(input_paths[i], output_suffix);
+    if (dep_suffix) {
+      jobs[i]->dep_path = CreateOutputPath(input_paths[i], dep_suffix);
+      jobs[i]->records_dependencies = true;
+      jobs[i]->dep_target = jobs[i]->output_path;
+    }
+  }
+  qsort(jobs, num_of_inputs, sizeof(jobs[0]), CompareJobsByInputSizeDesc);
+
+  num_of_work_queues = num_of_workers;
+  work_queues = calloc(num_of_work_queues, sizeof(struct WorkQueue));
+  for (int i = 0; i < num_of_work_queues; i++) {
+    work_queues[i].jobs =
+        calloc(num_of_inputs, sizeof(struct CompilationContext *));
+  }
+  for (int i = 0; i < num_of_inputs; i++) {
+    struct WorkQueue *q = &work_queues[0];
+    for (int k = 1; k < num_of_work_queues; k++) {
+      if (work_queues[k].load < q->load) q = &work_queues[k];
+    }
+    q->jobs[q->tail++] = jobs[i];
+    q->load += jobs[i]->input_size;
+  }
+
+  pthread_t *threads = calloc(num_of_workers, sizeof(pthread_t));
+  for (int i = 1; i < num_of_workers; i++) {
+    if (pthread_create(&threads[i], NULL, WorkerMain, &work_queues[i]))
+      Error("Failed to create a worker thread");
+  }
+  WorkerMain(&work_queues[0]);
+  for (int i = 1; i < num_of_workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
@@ -0,0 +1,218 @@
+#include "compilium.h"
+
+// Debug dumps for --dump=kinds, where kinds is a comma-separated list of
+// tokens, pp, ast, typed-ast and symbols. Compilations check
+// compilation->dump before anything is made for a dump, so they cost nothing
+// without --dump. Dumps are written as text, or as a JSON object per dump with
+// --dump-format=json, through a buffer on a duplicate of stderr. The buffer is
+// flushed after each dump to keep dumps in order with error messages.
+
+#define DUMP_BUFFER_SIZE (64 * 1024)
+
+static const char *dump_kind_names[kNumOfDumpKinds] = {
+    [kDumpTokens] = "tokens",
+    [kDumpPreprocessed] = "pp",
+    [kDumpAST] = "ast",
+    [kDumpTypedAST] = "typed-ast",
+    [kDumpSymbols] = "symbols",
+};
+
+static const char *symbol_type_names[] = {
+    [kSymbolLocalVar] = "LocalVar",
+    [kSymbolFuncDef] = "FuncDef",
+    [kSymbolFuncDeclType] = "FuncDeclType",
+    [kSymbolStructType] = "StructType",
+};
+
+static unsigned dump_kinds;  // bits of enum DumpKind given by --dump
+static bool is_dump_json = false;
+
+void AddDumpKinds(const char *kinds) {
+  // kinds is the comma-separated list given to --dump.
+  while (*kinds) {
+    const char *end = strchr(kinds, ',');
+    int length = end ? end - kinds : (int)strlen(kinds);
+    int kind = 0;
+    while (kind < kNumOfDumpKinds &&
+           !(strncmp(kinds, dump_kind_names[kind], length) == 0 &&
+             !dump_kind_names[kind][length]))
+      kind++;
+    if (kind == kNumOfDumpKinds)
+      Error("Unknown kind of dump: %.*s", length, kinds);
+    dump_kinds |= 1U << kind;
+    kinds += end ? length + 1 : length;
+  }
+}
+
+bool IsDumpKindEnabled(enum DumpKind kind) {
+  return dump_kinds & (1U << kind);
+}
+
+void SetDumpFormat(const char *format) {
+  if (strcmp(format, "json") == 0) {
+    is_dump_json = true;
+  } else if (strcmp(format, "text") == 0) {
+    is_dump_json = false;
+  } else {
+    Error("Unknown format of dump: %s", format);
+  }
+}
+
+void PrintJSONString(FILE *fp, const char *s, int length) {
+  fputc('"', fp);
+  for (int i = 0; i < length; i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      fputc('\\', fp);
+    } else if (c < 0x20) {
+      fprintf(fp, "\\u%04x", c);
+      continue;
+    }
+    fputc(c, fp);
+  }
+  fputc('"', fp);
+}
+
+void StartDump(void) {
+  // opens the output of dumps if --dump is given.
+  if (!dump_kinds) return;
+  int fd = dup(STDERR_FILENO);
+  FILE *fp = fd < 0 ? NULL : fdopen(fd, "w");
+  if (!fp) Error("Failed to open the output of --dump");
+  setvbuf(fp, NULL, _IOFBF, DUMP_BUFFER_SIZE);
+  compilation->dump = fp;
+}
+
+void CloseDump(void) {
+  fclose(compilation->dump);
+  compilation->dump = NULL;
+}
+
+static const char *GetDumpInputPath(void) {
+  return compilation->input_path ? compilation->input_path : "<stdin>";
+}
+
+static bool BeginDump(enum DumpKind kind) {
+  // returns false if kind is not dumped. Otherwise, the value of the dump
+  // should be written and followed by EndDump.
+  if (!IsDumpKindEnabled(kind)) return false;
+  FILE *fp = compilation->dump;
+  const char *path = GetDumpInputPath();
+  if (is_dump_json) {
+    fprintf(fp, "{\"input\": ");
+    PrintJSONString(fp, path, strlen(path));
+    fprintf(fp, ", \"dump\": \"%s\", \"value\": ", dump_kind_names[kind]);
+  } else {
+    fprintf(fp, "Dump of %s of %s:\n", dump_kind_names[kind], path);
+  }
+  return true;
+}
+
+static void EndDump(void) {
+  if (is_dump_json) fprintf(compilation->dump, "}\n");
+  fflush(compilation->dump);
+}
+
+static void DumpTokenList(struct TokenList *tokens) {
+  // writes tokens other than delimiters with the places they came from.
+  FILE *fp = compilation->dump;
+  if (is_dump_json) fprintf(fp, "[");
+  bool is_first = true;
+  for (int i = 0; i < tokens->size; i++) {
+    struct Token *t = &tokens->tokens[i];
+    if (t->type == kTokenDelimiter || t->type == kTokenZeroWidthNoBreakSpace)
+      continue;
+    const char *path = GetSourcePath(t->loc);
+    if (!path) path = GetDumpInputPath();
+    int line = GetSourceLine(t->loc);
+    if (!is_dump_json) {
+      fprintf(fp, "%s:%d: %-14s %.*s\n", path, line,
+              GetTokenTypeName(t->type), t->length, GetTokenBegin(t));
+      continue;
+    }
+    fprintf(fp, "%s\n  {\"type\": \"%s\", \"text\": ", is_first ? "" : ",",
+            GetTokenTypeName(t->type));
+    PrintJSONString(fp, GetTokenBegin(t), t->length);
+    fprintf(fp, ", \"path\": ");
+    PrintJSONString(fp, path, strlen(path));
+    fprintf(fp, ", \"line\": %d}", line);
+    is_first = false;
+  }
+  if (is_dump_json) fprintf(fp, "\n]");
+}
+
+void DumpSourceTokens(const char *input) {
+  // The input is lexed again for the dump, since it is lexed on demand.
+  if (!BeginDump(kDumpTokens)) return;
+  DumpTokenList(Tokenize(input));
+  EndDump();
+}
+
+void DumpPreprocessedTokens(struct TokenList *tokens) {
+  if (!BeginDump(kDumpPreprocessed)) return;
+  DumpTokenList(tokens);
+  EndDump();
+}
+
+void DumpAST(enum DumpKind kind, struct Node *ast) {
+  // kind is kDumpAST before analysis, or kDumpTypedAST after it.
+  if (!BeginDump(kind)) return;
+  if (is_dump_json) {
+    PrintASTNodeAsJSON(ast, compilation->dump);
+  } else {
+    PrintASTNodeToFile(ast, compilation->dump);
+  }
+  EndDump();
+}
+
+static struct Node *GetSymbolTypeForDump(struct SymbolEntry *e) {
+  struct Node *value = GetSymbolValue(e);
+  switch (GetSymbolType(e)) {
+    case kSymbolLocalVar:
+      return value->expr_type;
+    case kSymbolFuncDef:
+      return value->func_type;
+    case kSymbolFuncDeclType:
+      return GetTypeWithoutAttr(value);
+    case kSymbolStructType:
+      // The spec is written instead, since struct types are written by tag.
+      return value->type_struct_spec ? value->type_struct_spec : value;
+  }
+  assert(false);
+}
+
+void DumpSymbols(struct SymbolEntry *symbols) {
+  // symbols should be returned by Analyze. Symbols of the prelude are not
+  // written, and the others are written in the order of declaration.
+  if (!BeginDump(kDumpSymbols)) return;
+  FILE *fp = compilation->dump;
+  int num_of_symbols = 0;
+  for (struct SymbolEntry *e = symbols; e != compilation->prelude_symbols;
+       e = GetPrevSymbol(e))
+    num_of_symbols++;
+  struct SymbolEntry **entries =
+      malloc(sizeof(struct SymbolEntry *) * (num_of_symbols + 1));
+  assert(entries);
+  struct SymbolEntry *e = symbols;
+  for (int i = num_of_symbols - 1; i >= 0; i--, e = GetPrevSymbol(e))
+    entries[i] = e;
+  if (is_dump_json) fprintf(fp, "[");
+  for (int i = 0; i < num_of_symbols; i++) {
+    const char *type_name = symbol_type_names[GetSymbolType(entries[i])];
+    const char *name = GetAtomStr(GetSymbolAtom(entries[i]));
+    struct Node *type = GetSymbolTypeForDump(entries[i]);
+    if (!is_dump_json) {
+      fprintf(fp, "%s %s: ", type_name, name);
+      PrintASTNodeToFile(type, fp);
+      continue;
+    }
+    fprintf(fp, "%s\n  {\"kind\": \"%s\", \"name\": ", i ? "," : "",
+            type_name);
+    PrintJSONString(fp, name, strlen(name));
+    fprintf(fp, ", \"type\": ");
+    PrintASTNodeAsJSON(type, fp);
+    fprintf(fp, "}");
+  }
+  if (is_dump_json) fprintf(fp, "\n]");
+  EndDump();
+}
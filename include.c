@@ -0,0 +1,299 @@
+#include "compilium.h"
+
+// Headers are read once per process and kept in a cache shared by all
+// compilations. When a header is read, it is scanned once for #pragma once and
+// for an include guard, i.e. an #ifndef X ... #endif which wraps everything
+// else in the header. Including the header again then costs a lookup of the
+// cache and of the guard macro, without lexing the header.
+//
+// Tokens of headers are not cached. Their atoms and locations belong to a
+// compilation, so each compilation lexes the headers it includes, on demand
+// and only where they are not skipped by a guard or an inactive group.
+
+static const char **include_dirs;
+static int num_of_include_dirs;
+static int include_dirs_capacity;
+
+void AddIncludeDir(const char *dir) {
+  // dirs are searched in the order they are added.
+  if (num_of_include_dirs >= include_dirs_capacity) {
+    include_dirs_capacity = (include_dirs_capacity + 1) * 2;
+    include_dirs =
+        realloc(include_dirs, sizeof(const char *) * include_dirs_capacity);
+    assert(include_dirs);
+  }
+  include_dirs[num_of_include_dirs++] = dir;
+}
+
+struct HeaderFile {
+  const char *path;
+  const char *contents;
+  int size;
+  int id;  // index of compilation->included_headers
+  bool has_pragma_once;
+  const char *guard_name;  // NULL if the header has no include guard
+  int guard_name_length;
+  int guarded_begin;  // offset of the line after #ifndef
+  int guarded_end;    // offset of the # of the closing #endif
+};
+
+// Cache of headers keyed by path, shared by threads.
+static struct HeaderFile **header_cache;
+static int header_cache_size;
+static int num_of_cached_headers;
+static int header_cache_lock;
+
+static void LockHeaderCache(void) {
+  while (__atomic_exchange_n(&header_cache_lock, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+static void UnlockHeaderCache(void) {
+  __atomic_store_n(&header_cache_lock, 0, __ATOMIC_RELEASE);
+}
+
+static unsigned HashPath(const char *path) {
+  // FNV-1a
+  unsigned hash = 2166136261u;
+  for (const char *p = path; *p; p++) {
+    hash ^= (unsigned char)*p;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int GetHeaderCacheSlot(const char *path) {
+  // returns the slot which has path, or the empty slot to put path in.
+  int mask = header_cache_size - 1;
+  int i = HashPath(path) & mask;
+  while (header_cache[i] && strcmp(header_cache[i]->path, path) != 0)
+    i = (i + 1) & mask;
+  return i;
+}
+
+static void ExpandHeaderCacheIfNeeded(void) {
+  // keep the cache at most half full
+  if (num_of_cached_headers * 2 < header_cache_size) return;
+  struct HeaderFile **old_cache = header_cache;
+  int old_size = header_cache_size;
+  header_cache_size = old_size ? old_size * 2 : 64;
+  header_cache = calloc(header_cache_size, sizeof(struct HeaderFile *));
+  assert(header_cache);
+  for (int i = 0; i < old_size; i++) {
+    if (!old_cache[i]) continue;
+    header_cache[GetHeaderCacheSlot(old_cache[i]->path)] = old_cache[i];
+  }
+}
+
+// Scanning for include guards
+
+static bool LexSignificantToken(struct Token *t, const char **p,
+                                unsigned *loc) {
+  // skips spaces and comments. returns false at the end of input.
+  while (LexToken(t, p, loc)) {
+    if (t->type == kTokenDelimiter || t->type == kTokenZeroWidthNoBreakSpace)
+      continue;
+    return true;
+  }
+  return false;
+}
+
+static void SkipToNextLine(const char **p, unsigned *loc) {
+  struct Token t;
+  while (LexToken(&t, p, loc) && !IsEndOfLineToken(&t)) {
+  }
+}
+
+static void ScanHeader(struct HeaderFile *h, unsigned loc) {
+  // h->contents should be at loc.
+  const char *p = h->contents;
+  struct Token t;
+  int depth = 0;
+  int num_of_top_level_items = 0;
+  h->guard_name = NULL;
+  while (LexSignificantToken(&t, &p, &loc)) {
+    bool is_directive = IsPunctToken(&t, kPunctHash);
+    if (!depth && num_of_top_level_items++) h->guard_name = NULL;
+    if (!is_directive) {
+      SkipToNextLine(&p, &loc);
+      continue;
+    }
+    int hash_ofs = GetTokenBegin(&t) - h->contents;
+    struct Token name;
+    if (!LexSignificantToken(&name, &p, &loc)) break;
+    if (IsEqualTokenWithCStr(&name, "ifndef") && !depth &&
+        num_of_top_level_items == 1) {
+      struct Token guard;
+      if (LexSignificantToken(&guard, &p, &loc) &&
+          IsTokenWithType(&guard, kTokenIdent)) {
+        h->guard_name = GetTokenBegin(&guard);
+        h->guard_name_length = guard.length;
+      }
+      SkipToNextLine(&p, &loc);
+      h->guarded_begin = p - h->contents;
+      depth++;
+      continue;
+    }
+    if (IsEqualTokenWithCStr(&name, "pragma")) {
+      struct Token arg;
+      if (LexSignificantToken(&arg, &p, &loc) &&
+          IsEqualTokenWithCStr(&arg, "once"))
+        h->has_pragma_once = true;
+    } else if (IsEqualTokenWithCStr(&name, "if") ||
+               IsEqualTokenWithCStr(&name, "ifdef") ||
+               IsEqualTokenWithCStr(&name, "ifndef")) {
+      depth++;
+    } else if (IsEqualTokenWithCStr(&name, "else") ||
+               IsEqualTokenWithCStr(&name, "elif")) {
+      if (depth == 1) h->guard_name = NULL;
+    } else if (IsEqualTokenWithCStr(&name, "endif")) {
+      if (!depth) {
+        h->guard_name = NULL;
+      } else if (!--depth) {
+        h->guarded_end = hash_ofs;
+      }
+    }
+    SkipToNextLine(&p, &loc);
+  }
+  if (depth) h->guard_name = NULL;
+}
+
+// Resolving paths
+
+static bool IsReadableFile(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  close(fd);
+  return true;
+}
+
+static const char *JoinPath(const char *dir, int dir_length, const char *name,
+                            int name_length) {
+  int size = dir_length + 1 + name_length + 1;
+  char *path = malloc(size);
+  if (dir_length) {
+    snprintf(path, size, "%.*s/%.*s", dir_length, dir, name_length, name);
+  } else {
+    snprintf(path, size, "%.*s", name_length, name);
+  }
+  return path;
+}
+
+static const char *FindHeaderPath(struct Token *directive, const char *name,
+                                  int name_length, bool is_quoted) {
+  // "name" is searched in the directory of the file which includes it first.
+  if (name_length && name[0] == '/')
+    return JoinPath(NULL, 0, name, name_length);
+  if (is_quoted) {
+    const char *from = GetSourcePath(directive->loc);
+    int dir_length = 0;
+    for (int i = 0; from && from[i]; i++) {
+      if (from[i] == '/') dir_length = i;
+    }
+    const char *path = JoinPath(from, dir_length, name, name_length);
+    if (IsReadableFile(path)) return path;
+  }
+  for (int i = 0; i < num_of_include_dirs; i++) {
+    const char *path = JoinPath(include_dirs[i], strlen(include_dirs[i]), name,
+                                name_length);
+    if (IsReadableFile(path)) return path;
+  }
+  ErrorWithToken(directive, "Header not found: %.*s", name_length, name);
+}
+
+static struct HeaderFile *FindCachedHeaderFile(const char *path) {
+  // the cache should be locked.
+  return header_cache ? header_cache[GetHeaderCacheSlot(path)] : NULL;
+}
+
+static struct HeaderFile *GetHeaderFile(const char *path,
+                                        unsigned *scanned_loc) {
+  // reads path into the cache if it is not cached yet. If it is read here,
+  // *scanned_loc is set to the location of the header in this compilation.
+  *scanned_loc = 0;
+  LockHeaderCache();
+  struct HeaderFile *h = FindCachedHeaderFile(path);
+  UnlockHeaderCache();
+  if (h) return h;
+  // The header is read and scanned without the lock, so other threads are
+  // not kept waiting for it. Another thread may cache it meanwhile.
+  struct HeaderFile *read = calloc(1, sizeof(struct HeaderFile));
+  assert(read);
+  read->path = path;
+  read->contents = ReadInput(path);
+  read->size = strlen(read->contents);
+  // Locations of tokens scanned here are only valid in this compilation,
+  // but the results are offsets which any compilation can use.
+  unsigned loc = AddSourceBuffer(path, read->contents, read->size);
+  ScanHeader(read, loc);
+  LockHeaderCache();
+  h = FindCachedHeaderFile(path);
+  if (!h) {
+    ExpandHeaderCacheIfNeeded();
+    h = read;
+    h->id = num_of_cached_headers++;
+    header_cache[GetHeaderCacheSlot(path)] = h;
+    *scanned_loc = loc;
+  }
+  UnlockHeaderCache();
+  return h;
+}
+
+// Including
+
+struct IncludedHeader {
+  unsigned loc;  // 0 if the header is not in the source buffers yet
+  int guard_atom;
+  bool is_included;
+  bool is_dependency;  // added to the dependency file
+};
+
+static struct IncludedHeader *GetIncludedHeader(struct HeaderFile *h) {
+  // returns the state of h in this compilation.
+  if (h->id >= compilation->included_headers_capacity) {
+    int old_capacity = compilation->included_headers_capacity;
+    compilation->included_headers_capacity = (h->id + 1) * 2;
+    compilation->included_headers =
+        realloc(compilation->included_headers,
+                sizeof(struct IncludedHeader) *
+                    compilation->included_headers_capacity);
+    assert(compilation->included_headers);
+    memset(&compilation->included_headers[old_capacity], 0,
+           sizeof(struct IncludedHeader) *
+               (compilation->included_headers_capacity - old_capacity));
+  }
+  return &compilation->included_headers[h->id];
+}
+
+void IncludeHeader(struct Token *directive, const char *name, int name_length,
+                   bool is_quoted) {
+  // lexes the header before the rest of the input, unless its include guard
+  // or #pragma once tells that it has no effect.
+  unsigned scanned_loc;
+  struct HeaderFile *h = GetHeaderFile(
+      FindHeaderPath(directive, name, name_length, is_quoted), &scanned_loc);
+  struct IncludedHeader *ih = GetIncludedHeader(h);
+  if (scanned_loc) ih->loc = scanned_loc;
+  if (!ih->is_dependency) {
+    // Even a header skipped by its guard is a dependency, since a change of
+    // the guard would change the result.
+    AddDependency(h->path, h->contents, h->size);
+    ih->is_dependency = true;
+  }
+  if (ih->is_included && h->has_pragma_once) return;
+  if (h->guard_name) {
+    if (!ih->guard_atom)
+      ih->guard_atom = InternAtom(h->guard_name, h->guard_name_length);
+    struct Token guard = {.atom = ih->guard_atom};
+    if (FindMacro(&guard)) return;
+  }
+  if (!ih->loc) ih->loc = AddSourceBuffer(h->path, h->contents, h->size);
+  ih->is_included = true;
+  if (h->guard_name) {
+    // The guard itself is consumed here, so it is not preprocessed.
+    PushLexerInput(h->contents + h->guarded_begin,
+                   h->contents + h->guarded_end, ih->loc + h->guarded_begin);
+    return;
+  }
+  PushLexerInput(h->contents, h->contents + h->size, ih->loc);
+}
@@ -0,0 +1,3 @@
+#define O_RDONLY 0
+
+int open(const char *path, int oflag, ...);
@@ -0,0 +1,9 @@
+#ifdef __APPLE__
+typedef struct _opaque_pthread_t *pthread_t;
+#else
+typedef unsigned long pthread_t;
+#endif
+
+int pthread_create(pthread_t *thread, const void *attr,
+                   void *(*start_routine)(void *), void *arg);
+int pthread_join(pthread_t thread, void **value_ptr);
@@ -0,0 +1 @@
+#define offsetof(type, member) __builtin_offsetof(type, member)
@@ -1,5 +1,6 @@
 #define NULL 0
 #define EOF (-1)
+#define _IOFBF 0
 
 typedef unsigned long size_t;
 typedef struct FILE FILE;
@@ -26,4 +27,10 @@ int fputc(int c, FILE *);
 int putchar(int c);
 int getchar(void);
 int fflush(FILE *);
+int fileno(FILE *);
 
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int setvbuf(FILE *, char *buf, int mode, size_t size);
+int fclose(FILE *);
+size_t fwrite(const void *ptr, size_t size, size_t count, FILE *);
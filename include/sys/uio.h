@@ -0,0 +1,6 @@
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
@@ -0,0 +1,4 @@
+typedef long clock_t;
+#define CLOCKS_PER_SEC 1000000
+
+clock_t clock(void);
@@ -0,0 +1,21 @@
+typedef long ssize_t;
+typedef long off_t;
+
+#define SEEK_SET 0
+#define SEEK_END 2
+
+#define STDERR_FILENO 2
+
+ssize_t read(int fd, void *buf, size_t count);
+int close(int fd);
+int dup(int fd);
+int unlink(const char *path);
+off_t lseek(int fd, off_t offset, int whence);
+int getpagesize(void);
+
+#ifdef __APPLE__
+#define _SC_NPROCESSORS_ONLN 58
+#else
+#define _SC_NPROCESSORS_ONLN 84
+#endif
+long sysconf(int name);
@@ -0,0 +1,264 @@
+#include "compilium.h"
+
+// Macros defined by #define are kept in an open-addressing hash table keyed
+// by the atom of the macro name. #undef only clears the replacement of the
+// entry, so entries are never removed and probing needs no tombstones.
+//
+// The body of an object-like macro is expanded once and cached in its entry
+// with the names looked up during the expansion. Each #define and #undef
+// stamps its entry with a new generation, so the cache is valid as long as
+// none of those names got a generation newer than the cache.
+//
+// With --macro-stats, the expansions of other macros made for the cache are
+// also recorded in it, since they are not made again while the cache is used.
+
+struct InnerMacroExpansion {
+  int atom;
+  int depth;  // 1 for macros in the body
+  int num_of_tokens;  // other than delimiters
+};
+
+struct MacroExpansion {
+  int generation;  // when the expansion was made
+  struct TokenList *tokens;  // NULL if the body can not be expanded alone
+  int *dependency_atoms;
+  int num_of_dependency_atoms;
+  struct InnerMacroExpansion *inner_expansions;
+  int num_of_inner_expansions;
+};
+
+struct MacroEntry {
+  int atom;  // 0 for an empty slot
+  struct Node *replacement;  // NULL if the macro is undefined
+  int generation;  // of the last #define or #undef of atom
+  struct MacroExpansion *expansion;
+  bool is_expanding;
+};
+
+static int GetMacroSlot(int atom) {
+  // returns the slot which has atom, or the empty slot to put atom in.
+  int mask = compilation->macro_table_size - 1;
+  int i = ((unsigned)atom * 2654435761u) & mask;
+  while (compilation->macro_table[i].atom &&
+         compilation->macro_table[i].atom != atom)
+    i = (i + 1) & mask;
+  return i;
+}
+
+static void ExpandMacroTableIfNeeded(void) {
+  // keep the table at most half full
+  if (compilation->num_of_macros * 2 < compilation->macro_table_size) return;
+  struct MacroEntry *old_table = compilation->macro_table;
+  int old_size = compilation->macro_table_size;
+  compilation->macro_table_size = old_size ? old_size * 2 : 64;
+  compilation->macro_table =
+      calloc(compilation->macro_table_size, sizeof(struct MacroEntry));
+  assert(compilation->macro_table);
+  for (int i = 0; i < old_size; i++) {
+    if (!old_table[i].atom) continue;
+    compilation->macro_table[GetMacroSlot(old_table[i].atom)] = old_table[i];
+  }
+}
+
+void DefineMacro(struct Token *name, struct Node *replacement) {
+  // a later definition of the same name replaces the earlier one.
+  assert(name && name->atom && replacement);
+  ExpandMacroTableIfNeeded();
+  struct MacroEntry *e = &compilation->macro_table[GetMacroSlot(name->atom)];
+  if (!e->atom) {
+    e->atom = name->atom;
+    compilation->num_of_macros++;
+  }
+  e->replacement = replacement;
+  e->generation = ++compilation->macro_generation;
+}
+
+void UndefineMacro(struct Token *name) {
+  assert(name && name->atom);
+  if (!compilation->macro_table) return;
+  struct MacroEntry *e = &compilation->macro_table[GetMacroSlot(name->atom)];
+  if (!e->atom) return;
+  e->replacement = NULL;
+  e->generation = ++compilation->macro_generation;
+}
+
+struct Node *GetMacroInSlot(int slot, int *atom) {
+  // returns the replacement of the macro in the slot of the table, or NULL if
+  // no macro is defined in it. slot should be less than macro_table_size.
+  struct MacroEntry *e = &compilation->macro_table[slot];
+  *atom = e->atom;
+  return e->replacement;
+}
+
+struct Node *FindMacro(struct Token *name) {
+  // returns the replacement of name if name is a defined macro.
+  if (!name || !name->atom || !compilation->macro_table) return NULL;
+  return compilation->macro_table[GetMacroSlot(name->atom)].replacement;
+}
+
+// Expansion of object-like macros
+
+static void AddMacroDependencyAtom(int atom) {
+  if (compilation->num_of_macro_dependency_atoms >=
+      compilation->macro_dependency_atoms_capacity) {
+    compilation->macro_dependency_atoms_capacity =
+        (compilation->macro_dependency_atoms_capacity + 1) * 2;
+    compilation->macro_dependency_atoms =
+        realloc(compilation->macro_dependency_atoms,
+                sizeof(int) * compilation->macro_dependency_atoms_capacity);
+    assert(compilation->macro_dependency_atoms);
+  }
+  compilation->macro_dependency_atoms
+      [compilation->num_of_macro_dependency_atoms++] = atom;
+}
+
+static int AddInnerMacroExpansion(int atom, int depth) {
+  // returns the index of the expansion, whose tokens are counted later.
+  if (compilation->num_of_inner_macro_expansions >=
+      compilation->inner_macro_expansions_capacity) {
+    compilation->inner_macro_expansions_capacity =
+        (compilation->inner_macro_expansions_capacity + 1) * 2;
+    compilation->inner_macro_expansions = realloc(
+        compilation->inner_macro_expansions,
+        sizeof(struct InnerMacroExpansion) *
+            compilation->inner_macro_expansions_capacity);
+    assert(compilation->inner_macro_expansions);
+  }
+  struct InnerMacroExpansion *inner =
+      &compilation
+           ->inner_macro_expansions[compilation->num_of_inner_macro_expansions];
+  inner->atom = atom;
+  inner->depth = depth;
+  inner->num_of_tokens = 0;
+  return compilation->num_of_inner_macro_expansions++;
+}
+
+static int CountTokensOtherThanDelimiters(struct TokenList *list, int begin) {
+  int count = 0;
+  for (int i = begin; i < list->size; i++) {
+    count += list->tokens[i].type != kTokenDelimiter;
+  }
+  return count;
+}
+
+static bool IsMacroExpansionValid(struct MacroExpansion *x) {
+  for (int i = 0; i < x->num_of_dependency_atoms; i++) {
+    struct MacroEntry *e =
+        &compilation->macro_table[GetMacroSlot(x->dependency_atoms[i])];
+    if (e->generation > x->generation) return false;
+  }
+  return true;
+}
+
+static bool AppendMacroExpansion(struct TokenList *out, struct MacroEntry *e,
+                                 int line_atom, int depth);
+
+static bool AppendMacroBodyExpansion(struct TokenList *out,
+                                     struct TokenList *body, int line_atom,
+                                     int depth) {
+  // returns false if the expansion of body depends on tokens around it or on
+  // where it is expanded. depth is that of the macros in body.
+  for (int i = 0; i < body->size; i++) {
+    struct Token *t = &body->tokens[i];
+    if (t->type != kTokenIdent) {
+      PushTokenToList(out, t);
+      continue;
+    }
+    if (t->atom == line_atom) return false;
+    AddMacroDependencyAtom(t->atom);
+    struct MacroEntry *inner =
+        &compilation->macro_table[GetMacroSlot(t->atom)];
+    if (!inner->replacement) {
+      PushTokenToList(out, t);
+      continue;
+    }
+    int begin = out->size;
+    int index =
+        compilation->macro_stats ? AddInnerMacroExpansion(t->atom, depth) : -1;
+    if (!AppendMacroExpansion(out, inner, line_atom, depth)) return false;
+    if (index >= 0)
+      compilation->inner_macro_expansions[index].num_of_tokens =
+          CountTokensOtherThanDelimiters(out, begin);
+  }
+  return true;
+}
+
+static bool AppendMacroExpansion(struct TokenList *out, struct MacroEntry *e,
+                                 int line_atom, int depth) {
+  // e should be a defined macro, which is expanded at depth.
+  if (e->replacement->macro_params) return false;
+  // Names in their own expansion are not expanded again, which is left to
+  // the rescan of the stream.
+  if (e->is_expanding) return false;
+  struct MacroExpansion *x = e->expansion;
+  if (x && x->tokens && IsMacroExpansionValid(x)) {
+    for (int i = 0; i < x->tokens->size; i++) {
+      PushTokenToList(out, &x->tokens->tokens[i]);
+    }
+    for (int i = 0; i < x->num_of_dependency_atoms; i++) {
+      AddMacroDependencyAtom(x->dependency_atoms[i]);
+    }
+    for (int i = 0; compilation->macro_stats && i < x->num_of_inner_expansions;
+         i++) {
+      struct InnerMacroExpansion *inner = &x->inner_expansions[i];
+      int index = AddInnerMacroExpansion(inner->atom, depth + inner->depth);
+      compilation->inner_macro_expansions[index].num_of_tokens =
+          inner->num_of_tokens;
+    }
+    return true;
+  }
+  e->is_expanding = true;
+  bool is_expanded = AppendMacroBodyExpansion(out, e->replacement->macro_body,
+                                              line_atom, depth + 1);
+  e->is_expanding = false;
+  return is_expanded;
+}
+
+static void CountInnerMacroStats(struct MacroExpansion *x) {
+  // counts the expansions which the cached tokens of x were made with.
+  for (int i = 0; i < x->num_of_inner_expansions; i++) {
+    struct InnerMacroExpansion *inner = &x->inner_expansions[i];
+    CountMacroStatsInnerExpansion(inner->atom, inner->depth,
+                                  inner->num_of_tokens);
+  }
+}
+
+struct TokenList *GetExpandedMacroBody(struct Token *name) {
+  // returns the fully expanded body of the object-like macro name, or NULL if
+  // it should be rescanned with the tokens after it.
+  struct MacroEntry *e = &compilation->macro_table[GetMacroSlot(name->atom)];
+  assert(e->replacement && !e->replacement->macro_params);
+  struct MacroExpansion *x = e->expansion;
+  if (x && IsMacroExpansionValid(x)) {
+    if (compilation->macro_stats && x->tokens) CountInnerMacroStats(x);
+    return x->tokens;
+  }
+  if (!x) x = e->expansion = AllocFromArena(sizeof(struct MacroExpansion));
+  compilation->num_of_macro_dependency_atoms = 0;
+  compilation->num_of_inner_macro_expansions = 0;
+  AddMacroDependencyAtom(e->atom);
+  struct TokenList *tokens = AllocTokenList();
+  int line_atom = InternAtom("__LINE__", strlen("__LINE__"));
+  e->is_expanding = true;
+  bool is_expanded = AppendMacroBodyExpansion(
+      tokens, e->replacement->macro_body, line_atom, 1);
+  e->is_expanding = false;
+  x->generation = compilation->macro_generation;
+  x->tokens = is_expanded ? tokens : NULL;
+  x->num_of_dependency_atoms = compilation->num_of_macro_dependency_atoms;
+  x->dependency_atoms =
+      AllocFromArena(sizeof(int) * x->num_of_dependency_atoms);
+  memcpy(x->dependency_atoms, compilation->macro_dependency_atoms,
+         sizeof(int) * x->num_of_dependency_atoms);
+  x->num_of_inner_expansions = compilation->num_of_inner_macro_expansions;
+  // The scratch array is NULL until a macro has an inner expansion.
+  x->inner_expansions = NULL;
+  if (x->num_of_inner_expansions) {
+    x->inner_expansions = AllocFromArena(sizeof(struct InnerMacroExpansion) *
+                                         x->num_of_inner_expansions);
+    memcpy(x->inner_expansions, compilation->inner_macro_expansions,
+           sizeof(struct InnerMacroExpansion) * x->num_of_inner_expansions);
+  }
+  if (compilation->macro_stats && x->tokens) CountInnerMacroStats(x);
+  return x->tokens;
+}
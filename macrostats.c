@@ -0,0 +1,159 @@
+#include "compilium.h"
+
+// Statistics of macro expansions for --macro-stats. An expansion is active
+// while tokens inserted by it are left in the stream, i.e. while the stream
+// has more token slices than before the expansion. Tokens written and time
+// spent while an expansion is active are counted for it, including those of
+// the expansions nested in it.
+//
+// An expansion is nested in those active when its name is read, even if the
+// rest of their tokens are read as its arguments. Only the innermost active
+// expansion is checked for its end, so the outer ones end with it or later,
+// and a macro whose body ends with a call of another macro is counted with
+// the tokens of the call. Expansions made for the cached body of an
+// object-like macro are counted whenever the cache is used, with their tokens
+// but without time.
+
+struct MacroStats {
+  int num_of_expansions;
+  long num_of_tokens;  // written while the macro was being expanded
+  clock_t time;
+  int max_depth;  // 1 for expansions which are not nested
+};
+
+struct ActiveExpansion {
+  int atom;
+  int base_slice_depth;
+  long base_num_of_tokens;
+  clock_t begin_time;
+};
+
+struct MacroStatsContext {
+  struct MacroStats *stats;  // indexed by atom
+  int stats_capacity;
+  struct ActiveExpansion *active;
+  int num_of_active;
+  int active_capacity;
+  long num_of_tokens;  // written by the preprocessor so far
+};
+
+void StartMacroStats(void) {
+  compilation->macro_stats = calloc(1, sizeof(struct MacroStatsContext));
+  assert(compilation->macro_stats);
+}
+
+static struct MacroStats *GetMacroStats(int atom) {
+  struct MacroStatsContext *c = compilation->macro_stats;
+  if (atom >= c->stats_capacity) {
+    int old_capacity = c->stats_capacity;
+    c->stats_capacity = (atom + 1) * 2;
+    c->stats = realloc(c->stats, sizeof(struct MacroStats) * c->stats_capacity);
+    assert(c->stats);
+    memset(&c->stats[old_capacity], 0,
+           sizeof(struct MacroStats) * (c->stats_capacity - old_capacity));
+  }
+  return &c->stats[atom];
+}
+
+void UpdateMacroStats(void) {
+  // ends the expansions whose tokens are all read. should be called before
+  // each token is read.
+  struct MacroStatsContext *c = compilation->macro_stats;
+  while (c->num_of_active &&
+         c->active[c->num_of_active - 1].base_slice_depth >=
+             compilation->num_of_token_slices) {
+    struct ActiveExpansion *a = &c->active[--c->num_of_active];
+    struct MacroStats *s = GetMacroStats(a->atom);
+    s->num_of_tokens += c->num_of_tokens - a->base_num_of_tokens;
+    s->time += clock() - a->begin_time;
+  }
+}
+
+static void UpdateMaxDepth(struct MacroStats *s, int depth) {
+  if (depth > s->max_depth) s->max_depth = depth;
+}
+
+void BeginMacroStats(struct Token *macro_name) {
+  // should be called just before the replacement of macro_name is inserted,
+  // and UpdateMacroStats should be called before macro_name is read.
+  struct MacroStatsContext *c = compilation->macro_stats;
+  if (c->num_of_active >= c->active_capacity) {
+    c->active_capacity = (c->active_capacity + 1) * 2;
+    c->active = realloc(c->active,
+                        sizeof(struct ActiveExpansion) * c->active_capacity);
+    assert(c->active);
+  }
+  struct ActiveExpansion *a = &c->active[c->num_of_active++];
+  a->atom = macro_name->atom;
+  a->base_slice_depth = compilation->num_of_token_slices;
+  a->base_num_of_tokens = c->num_of_tokens;
+  a->begin_time = clock();
+  struct MacroStats *s = GetMacroStats(a->atom);
+  s->num_of_expansions++;
+  UpdateMaxDepth(s, c->num_of_active);
+}
+
+void CountMacroStatsToken(void) {
+  compilation->macro_stats->num_of_tokens++;
+}
+
+void CountMacroStatsInnerExpansion(int atom, int depth, int num_of_tokens) {
+  // counts an expansion made at depth in the innermost active expansion.
+  struct MacroStatsContext *c = compilation->macro_stats;
+  struct MacroStats *s = GetMacroStats(atom);
+  s->num_of_expansions++;
+  s->num_of_tokens += num_of_tokens;
+  UpdateMaxDepth(s, c->num_of_active + depth);
+}
+
+static int CompareMacroStatsAtoms(const void *a, const void *b) {
+  // by tokens, then by time, in descending order
+  struct MacroStatsContext *c = compilation->macro_stats;
+  struct MacroStats *sa = &c->stats[*(const int *)a];
+  struct MacroStats *sb = &c->stats[*(const int *)b];
+  if (sa->num_of_tokens != sb->num_of_tokens)
+    return sa->num_of_tokens < sb->num_of_tokens ? 1 : -1;
+  if (sa->time != sb->time) return sa->time < sb->time ? 1 : -1;
+  return *(const int *)a - *(const int *)b;
+}
+
+void PrintMacroStats(bool is_json) {
+  // prints the stats of the macros expanded at least once to stderr.
+  struct MacroStatsContext *c = compilation->macro_stats;
+  UpdateMacroStats();
+  int *atoms = malloc(sizeof(int) * (c->stats_capacity + 1));
+  assert(atoms);
+  int num_of_atoms = 0;
+  for (int i = 0; i < c->stats_capacity; i++) {
+    if (c->stats[i].num_of_expansions) atoms[num_of_atoms++] = i;
+  }
+  qsort(atoms, num_of_atoms, sizeof(int), CompareMacroStatsAtoms);
+  const char *path =
+      compilation->input_path ? compilation->input_path : "<stdin>";
+  if (is_json) {
+    fprintf(stderr, "{\"input\": ");
+    PrintJSONString(stderr, path, strlen(path));
+    fprintf(stderr, ", \"macros\": [");
+  } else {
+    fprintf(stderr, "Macro stats of %s:\n", path);
+    fprintf(stderr, "%-24s %10s %12s %10s %6s\n", "name", "expansions",
+            "tokens", "time(ms)", "depth");
+  }
+  for (int i = 0; i < num_of_atoms; i++) {
+    struct MacroStats *s = &c->stats[atoms[i]];
+    const char *name = GetAtomStr(atoms[i]);
+    double msec = (double)s->time * 1000 / CLOCKS_PER_SEC;
+    if (is_json) {
+      fprintf(stderr, "%s\n  {\"name\": ", i ? "," : "");
+      PrintJSONString(stderr, name, strlen(name));
+      fprintf(stderr,
+              ", \"expansions\": %d, \"tokens\": %ld, \"time_ms\": %.3f, "
+              "\"max_depth\": %d}",
+              s->num_of_expansions, s->num_of_tokens, msec, s->max_depth);
+    } else {
+      fprintf(stderr, "%-24s %10d %12ld %10.3f %6d\n", name,
+              s->num_of_expansions, s->num_of_tokens, msec, s->max_depth);
+    }
+  }
+  if (is_json) fprintf(stderr, "\n]}\n");
+}
@@ -0,0 +1,87 @@
+#include "compilium.h"
+
+// Accounting of allocations for --mem-report. Each allocation site counts
+// what it allocates while a report is enabled, and reallocations count the
+// bytes by which they grow. Nodes are counted by type with --node-stats, and
+// tokens copied into token lists are counted by type of token.
+
+struct MemSiteStats {
+  long num_of_allocs;
+  long bytes;
+};
+
+struct MemReport {
+  struct MemSiteStats sites[kNumOfMemSites];
+  struct MemSiteStats tokens[kNumOfTokenTypes];
+};
+
+static const char *mem_site_names[kNumOfMemSites] = {
+    [kMemSiteAllocNode] = "AllocNode",
+    [kMemSiteAllocToken] = "AllocToken",
+    [kMemSiteAllocTokenList] = "AllocTokenList",
+    [kMemSiteExpandTokenList] = "ExpandTokenListSizeIfNeeded",
+    [kMemSiteExpandList] = "ExpandListSizeIfNeeded",
+    [kMemSiteAllocTokenChunk] = "AllocTokenChunk",
+    [kMemSiteCopyStr] = "CopyStrToArena",
+    [kMemSiteAllocSymbolEntry] = "AllocSymbolEntry",
+    [kMemSiteBuildLineIndex] = "BuildLineIndex",
+};
+
+void StartMemReport(void) {
+  compilation->mem_report = calloc(1, sizeof(struct MemReport));
+  assert(compilation->mem_report);
+  if (!compilation->node_stats) StartNodeStats();
+}
+
+void CountMemReportAlloc(enum MemSite site, size_t size) {
+  struct MemSiteStats *s = &compilation->mem_report->sites[site];
+  s->num_of_allocs++;
+  s->bytes += size;
+}
+
+void CountMemReportToken(struct Token *t) {
+  struct MemSiteStats *s = &compilation->mem_report->tokens[t->type];
+  s->num_of_allocs++;
+  s->bytes += sizeof(struct Token);
+}
+
+static long GetPeakRSSInKB(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) return -1;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // in bytes on macOS
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+static void PrintMemSiteStats(const char *name, struct MemSiteStats *s) {
+  fprintf(stderr, "%-28s %10ld %12ld\n", name, s->num_of_allocs, s->bytes);
+}
+
+void PrintMemReport(void) {
+  // prints the allocations counted so far to stderr.
+  struct MemReport *r = compilation->mem_report;
+  const char *path =
+      compilation->input_path ? compilation->input_path : "<stdin>";
+  fprintf(stderr, "Memory report of %s:\n", path);
+  fprintf(stderr, "%-28s %10s %12s\n", "site", "allocs", "bytes");
+  struct MemSiteStats total = {0, 0};
+  for (int i = 0; i < kNumOfMemSites; i++) {
+    PrintMemSiteStats(mem_site_names[i], &r->sites[i]);
+    total.num_of_allocs += r->sites[i].num_of_allocs;
+    total.bytes += r->sites[i].bytes;
+  }
+  PrintMemSiteStats("total", &total);
+  fprintf(stderr, "%-28s %10s %12s\n", "token type", "tokens", "bytes");
+  for (int i = 0; i < kNumOfTokenTypes; i++) {
+    if (r->tokens[i].num_of_allocs)
+      PrintMemSiteStats(GetTokenTypeName(i), &r->tokens[i]);
+  }
+  PrintNodeStats();
+  size_t used, reserved;
+  GetArenaUsage(&compilation->arena, &used, &reserved);
+  fprintf(stderr, "arena: %zu bytes used of %zu bytes reserved\n", used,
+          reserved);
+  fprintf(stderr, "peak RSS of the process: %ld KB\n", GetPeakRSSInKB());
+}
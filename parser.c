@@ -7,7 +7,7 @@ struct Node *ParseCastExpr();
 struct Node *ParseExpr(void);
 
 struct Node *ParsePrimaryExpr() {
-  struct Node *t;
+  struct Token *t;
   if ((t = ConsumeToken(kTokenDecimalNumber)) ||
       (t = ConsumeToken(kTokenOctalNumber)) ||
       (t = ConsumeToken(kTokenIdent)) ||
@@ -17,12 +17,12 @@ struct Node *ParsePrimaryExpr() {
     op->op = t;
     return op;
   }
-  if ((t = ConsumePunctuator("("))) {
+  if ((t = ConsumePunct(kPunctLParen))) {
     struct Node *op = AllocNode(kASTExpr);
     op->op = t;
     op->right = ParseExpr();
     if (!op->right) ErrorWithToken(t, "Expected expr after this token");
-    ExpectPunctuator(")");
+    ExpectPunct(kPunctRParen);
     return op;
   }
   return NULL;
@@ -32,17 +32,17 @@ struct Node *ParseAssignExpr();
 struct Node *ParsePostfixExpr() {
   struct Node *n = ParsePrimaryExpr();
   while (n) {
-    struct Node *t;
-    if (ConsumePunctuator("(")) {
+    struct Token *t;
+    if (ConsumePunct(kPunctLParen)) {
       struct Node *args = AllocList();
-      if (!ConsumePunctuator(")")) {
+      if (!ConsumePunct(kPunctRParen)) {
         do {
           struct Node *arg_expr = ParseAssignExpr();
           if (!arg_expr)
             ErrorWithToken(NextToken(), "Expected expression here");
           PushToList(args, arg_expr);
-        } while (ConsumePunctuator(","));
-        ExpectPunctuator(")");
+        } while (ConsumePunct(kPunctComma));
+        ExpectPunct(kPunctRParen);
       }
       struct Node *nn = AllocNode(kASTExprFuncCall);
       nn->func_expr = n;
@@ -50,18 +50,19 @@ struct Node *ParsePostfixExpr() {
       n = nn;
       continue;
     }
-    if ((t = ConsumePunctuator("["))) {
+    if ((t = ConsumePunct(kPunctLBracket))) {
       n = CreateASTBinOp(t, n, ParseExpr());
-      ExpectPunctuator("]");
+      ExpectPunct(kPunctRBracket);
       continue;
     }
-    if ((t = ConsumePunctuator(".")) || (t = ConsumePunctuator("->"))) {
-      struct Node *right = ConsumeToken(kTokenIdent);
+    if ((t = ConsumePunctInSet(PUNCT_SET(kPunctDot) |
+                               PUNCT_SET(kPunctArrow)))) {
+      struct Token *right = ConsumeToken(kTokenIdent);
       assert(right);
-      n = CreateASTBinOp(t, n, right);
+      n = CreateASTBinOp(t, n, CreateASTIdent(right));
       continue;
     }
-    if ((t = ConsumePunctuator("++"))) {
+    if ((t = ConsumePunct(kPunctInc))) {
       n = CreateASTUnaryPostfixOp(n, t);
       continue;
     }
@@ -71,10 +72,10 @@ struct Node *ParsePostfixExpr() {
 }
 
 struct Node *ParseUnaryExpr() {
-  struct Node *t;
-  if ((t = ConsumePunctuator("+")) || (t = ConsumePunctuator("-")) ||
-      (t = ConsumePunctuator("~")) || (t = ConsumePunctuator("!")) ||
-      (t = ConsumePunctuator("&")) || (t = ConsumePunctuator("*"))) {
+  struct Token *t;
+  if ((t = ConsumePunctInSet(PUNCT_SET(kPunctPlus) | PUNCT_SET(kPunctMinus) |
+                             PUNCT_SET(kPunctTilde) | PUNCT_SET(kPunctExcl) |
+                             PUNCT_SET(kPunctAmp) | PUNCT_SET(kPunctStar)))) {
     return CreateASTUnaryPrefixOp(t, ParseCastExpr());
   } else if ((t = ConsumeToken(kTokenKwSizeof))) {
     return CreateASTUnaryPrefixOp(t, ParseUnaryExpr());
@@ -89,9 +90,9 @@ struct Node *ParseCastExpr() {
 struct Node *ParseMulExpr() {
   struct Node *op = ParseCastExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("*")) || (t = ConsumePunctuator("/")) ||
-         (t = ConsumePunctuator("%"))) {
+  struct Token *t;
+  while ((t = ConsumePunctInSet(PUNCT_SET(kPunctStar) | PUNCT_SET(kPunctSlash) |
+                                PUNCT_SET(kPunctPercent)))) {
     op = CreateASTBinOp(t, op, ParseCastExpr());
   }
   return op;
@@ -100,8 +101,9 @@ struct Node *ParseMulExpr() {
 struct Node *ParseAddExpr() {
   struct Node *op = ParseMulExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("+")) || (t = ConsumePunctuator("-"))) {
+  struct Token *t;
+  while ((t = ConsumePunctInSet(PUNCT_SET(kPunctPlus) |
+                                PUNCT_SET(kPunctMinus)))) {
     op = CreateASTBinOp(t, op, ParseMulExpr());
   }
   return op;
@@ -110,8 +112,9 @@ struct Node *ParseAddExpr() {
 struct Node *ParseShiftExpr() {
   struct Node *op = ParseAddExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("<<")) || (t = ConsumePunctuator(">>"))) {
+  struct Token *t;
+  while ((t = ConsumePunctInSet(PUNCT_SET(kPunctLShift) |
+                                PUNCT_SET(kPunctRShift)))) {
     op = CreateASTBinOp(t, op, ParseAddExpr());
   }
   return op;
@@ -120,9 +123,10 @@ struct Node *ParseShiftExpr() {
 struct Node *ParseRelExpr() {
   struct Node *op = ParseShiftExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("<")) || (t = ConsumePunctuator(">")) ||
-         (t = ConsumePunctuator("<=")) || (t = ConsumePunctuator(">="))) {
+  struct Token *t;
+  while ((t = ConsumePunctInSet(PUNCT_SET(kPunctLt) | PUNCT_SET(kPunctGt) |
+                                PUNCT_SET(kPunctLtEq) |
+                                PUNCT_SET(kPunctGtEq)))) {
     op = CreateASTBinOp(t, op, ParseShiftExpr());
   }
   return op;
@@ -131,8 +135,9 @@ struct Node *ParseRelExpr() {
 struct Node *ParseEqExpr() {
   struct Node *op = ParseRelExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("==")) || (t = ConsumePunctuator("!="))) {
+  struct Token *t;
+  while ((t = ConsumePunctInSet(PUNCT_SET(kPunctEq) |
+                                PUNCT_SET(kPunctNotEq)))) {
     op = CreateASTBinOp(t, op, ParseRelExpr());
   }
   return op;
@@ -141,8 +146,8 @@ struct Node *ParseEqExpr() {
 struct Node *ParseAndExpr() {
   struct Node *op = ParseEqExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("&"))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctAmp))) {
     op = CreateASTBinOp(t, op, ParseEqExpr());
   }
   return op;
@@ -151,8 +156,8 @@ struct Node *ParseAndExpr() {
 struct Node *ParseXorExpr() {
   struct Node *op = ParseAndExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("^"))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctCaret))) {
     op = CreateASTBinOp(t, op, ParseAndExpr());
   }
   return op;
@@ -161,8 +166,8 @@ struct Node *ParseXorExpr() {
 struct Node *ParseOrExpr() {
   struct Node *op = ParseXorExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("|"))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctBar))) {
     op = CreateASTBinOp(t, op, ParseXorExpr());
   }
   return op;
@@ -171,8 +176,8 @@ struct Node *ParseOrExpr() {
 struct Node *ParseBoolAndExpr() {
   struct Node *op = ParseOrExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("&&"))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctAmpAmp))) {
     op = CreateASTBinOp(t, op, ParseOrExpr());
   }
   return op;
@@ -181,8 +186,8 @@ struct Node *ParseBoolAndExpr() {
 struct Node *ParseBoolOrExpr() {
   struct Node *op = ParseBoolAndExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("||"))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctBarBar))) {
     op = CreateASTBinOp(t, op, ParseBoolAndExpr());
   }
   return op;
@@ -191,15 +196,15 @@ struct Node *ParseBoolOrExpr() {
 struct Node *ParseConditionalExpr() {
   struct Node *expr = ParseBoolOrExpr();
   if (!expr) return NULL;
-  struct Node *t;
-  if ((t = ConsumePunctuator("?"))) {
+  struct Token *t;
+  if ((t = ConsumePunct(kPunctQuestion))) {
     struct Node *op = AllocNode(kASTExpr);
     op->op = t;
     op->cond = expr;
     op->left = ParseConditionalExpr();
     if (!op->left)
       ErrorWithToken(t, "Expected true-expr for this conditional expr");
-    ExpectPunctuator(":");
+    ExpectPunct(kPunctColon);
     op->right = ParseConditionalExpr();
     if (!op->right)
       ErrorWithToken(t, "Expected false-expr for this conditional expr");
@@ -211,11 +216,12 @@ struct Node *ParseConditionalExpr() {
 struct Node *ParseAssignExpr() {
   struct Node *left = ParseConditionalExpr();
   if (!left) return NULL;
-  struct Node *t;
-  if ((t = ConsumePunctuator("=")) || (t = ConsumePunctuator("+=")) ||
-      (t = ConsumePunctuator("-=")) || (t = ConsumePunctuator("*=")) ||
-      (t = ConsumePunctuator("/=")) || (t = ConsumePunctuator("%=")) ||
-      (t = ConsumePunctuator("<<=")) || (t = ConsumePunctuator(">>="))) {
+  struct Token *t;
+  if ((t = ConsumePunctInSet(
+           PUNCT_SET(kPunctAssign) | PUNCT_SET(kPunctPlusAssign) |
+           PUNCT_SET(kPunctMinusAssign) | PUNCT_SET(kPunctStarAssign) |
+           PUNCT_SET(kPunctSlashAssign) | PUNCT_SET(kPunctPercentAssign) |
+           PUNCT_SET(kPunctLShiftAssign) | PUNCT_SET(kPunctRShiftAssign)))) {
     struct Node *right = ParseAssignExpr();
     if (!right) ErrorWithToken(t, "Expected expr after this token");
     return CreateASTBinOp(t, left, right);
@@ -226,8 +232,8 @@ struct Node *ParseAssignExpr() {
 struct Node *ParseExpr() {
   struct Node *op = ParseAssignExpr();
   if (!op) return NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator(","))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctComma))) {
     op = CreateASTBinOp(t, op, ParseAssignExpr());
   }
   return op;
@@ -235,22 +241,22 @@ struct Node *ParseExpr() {
 
 struct Node *ParseExprStmt() {
   struct Node *expr = ParseExpr();
-  struct Node *t;
-  if ((t = ConsumePunctuator(";"))) {
+  struct Token *t;
+  if ((t = ConsumePunct(kPunctSemicolon))) {
     return CreateASTExprStmt(t, expr);
   } else if (expr) {
-    ExpectPunctuator(";");
+    ExpectPunct(kPunctSemicolon);
   }
   return NULL;
 }
 
 struct Node *ParseSelectionStmt() {
-  struct Node *t;
+  struct Token *t;
   if ((t = ConsumeToken(kTokenKwIf))) {
-    ExpectPunctuator("(");
+    ExpectPunct(kPunctLParen);
     struct Node *expr = ParseExpr();
     assert(expr);
-    ExpectPunctuator(")");
+    ExpectPunct(kPunctRParen);
     struct Node *stmt_true = ParseStmt();
     assert(stmt_true);
     struct Node *stmt = AllocNode(kASTSelectionStmt);
@@ -266,10 +272,10 @@ struct Node *ParseSelectionStmt() {
 }
 
 struct Node *ParseJumpStmt() {
-  struct Node *t;
+  struct Token *t;
   if ((t = ConsumeToken(kTokenKwReturn))) {
     struct Node *expr = ParseExpr();
-    ExpectPunctuator(";");
+    ExpectPunct(kPunctSemicolon);
     struct Node *stmt = AllocNode(kASTJumpStmt);
     stmt->op = t;
     stmt->right = expr;
@@ -279,16 +285,16 @@ struct Node *ParseJumpStmt() {
 }
 
 struct Node *ParseIterationStmt() {
-  struct Node *t;
+  struct Token *t;
   if ((t = ConsumeToken(kTokenKwFor))) {
-    ExpectPunctuator("(");
+    ExpectPunct(kPunctLParen);
     struct Node *init = ParseDeclBody();
     if (!init) init = ParseExpr();
-    ExpectPunctuator(";");
+    ExpectPunct(kPunctSemicolon);
     struct Node *cond = ParseExpr();
-    ExpectPunctuator(";");
+    ExpectPunct(kPunctSemicolon);
     struct Node *updt = ParseExpr();
-    ExpectPunctuator(")");
+    ExpectPunct(kPunctRParen);
     struct Node *body = ParseStmt();
     assert(body);
 
@@ -301,10 +307,10 @@ struct Node *ParseIterationStmt() {
     return stmt;
   }
   if ((t = ConsumeToken(kTokenKwWhile))) {
-    ExpectPunctuator("(");
+    ExpectPunct(kPunctLParen);
     struct Node *cond = ParseExpr();
     assert(cond);
-    ExpectPunctuator(")");
+    ExpectPunct(kPunctRParen);
     struct Node *body = ParseStmt();
     assert(body);
 
@@ -328,22 +334,22 @@ struct Node *ParseStmt() {
 
 struct Node *ParseDecl();
 struct Node *ParseDeclSpecs() {
-  struct Node *decl_spec;
-  (decl_spec = ConsumeToken(kTokenKwInt)) ||
-      (decl_spec = ConsumeToken(kTokenKwChar)) ||
-      (decl_spec = ConsumeToken(kTokenKwVoid));
-  if (decl_spec) return decl_spec;
-  if (ConsumeToken(kTokenKwStruct)) {
+  struct Token *t;
+  if ((t = ConsumeToken(kTokenKwInt)) || (t = ConsumeToken(kTokenKwChar)) ||
+      (t = ConsumeToken(kTokenKwVoid)))
+    return CreateTypeBase(t);
+  if ((t = ConsumeToken(kTokenKwStruct))) {
     struct Node *struct_spec = AllocNode(kASTStructSpec);
+    struct_spec->op = t;
     struct_spec->tag = ConsumeToken(kTokenIdent);
     assert(struct_spec->tag);
-    if (ConsumePunctuator("{")) {
+    if (ConsumePunct(kPunctLBrace)) {
       struct_spec->struct_member_dict = AllocList();
       struct Node *decl;
       while ((decl = ParseDecl())) {
         AddMemberOfStructFromDecl(struct_spec, decl);
       }
-      ExpectPunctuator("}");
+      ExpectPunct(kPunctRBrace);
     }
     return struct_spec;
   }
@@ -355,28 +361,28 @@ struct Node *ParseDecltor();
 struct Node *ParseDirectDecltor() {
   // always allow abstract decltors
   struct Node *n = NULL;
-  struct Node *t;
-  if ((t = ConsumePunctuator("("))) {
+  struct Token *t;
+  if ((t = ConsumePunct(kPunctLParen))) {
     n = AllocNode(kASTDirectDecltor);
     n->op = t;
-    n->value = ParseDecltor();
-    assert(n->value);
-    ExpectPunctuator(")");
+    n->decltor = ParseDecltor();
+    assert(n->decltor);
+    ExpectPunct(kPunctRParen);
   } else if ((t = ConsumeToken(kTokenIdent))) {
     n = AllocNode(kASTDirectDecltor);
     n->op = t;
   }
   while (true) {
-    if ((t = ConsumePunctuator("("))) {
+    if ((t = ConsumePunct(kPunctLParen))) {
       struct Node *args = AllocList();
-      if (!ConsumePunctuator(")")) {
+      if (!ConsumePunct(kPunctRParen)) {
         while (1) {
           struct Node *arg = ParseParamDecl();
           if (!arg) ErrorWithToken(NextToken(), "Expected ParamDecl here");
           PushToList(args, arg);
-          if (!ConsumePunctuator(",")) break;
+          if (!ConsumePunct(kPunctComma)) break;
         }
-        ExpectPunctuator(")");
+        ExpectPunct(kPunctRParen);
       }
       struct Node *nn = AllocNode(kASTDirectDecltor);
       nn->op = t;
@@ -384,13 +390,13 @@ struct Node *ParseDirectDecltor() {
       nn->left = n;
       n = nn;
     }
-    if ((t = ConsumePunctuator("["))) {
+    if ((t = ConsumePunct(kPunctLBracket))) {
       struct Node *nn = AllocNode(kASTDirectDecltor);
       nn->op = t;
       nn->right = ParseAssignExpr();
       nn->left = n;
       n = nn;
-      ExpectPunctuator("]");
+      ExpectPunct(kPunctRBracket);
       continue;
     }
     break;
@@ -401,8 +407,8 @@ struct Node *ParseDirectDecltor() {
 struct Node *ParseDecltor() {
   struct Node *n = AllocNode(kASTDecltor);
   struct Node *pointer = NULL;
-  struct Node *t;
-  while ((t = ConsumePunctuator("*"))) {
+  struct Token *t;
+  while ((t = ConsumePunct(kPunctStar))) {
     pointer = CreateTypePointer(pointer);
   }
   n->left = pointer;
@@ -413,8 +419,8 @@ struct Node *ParseDecltor() {
 struct Node *ParseInitDecltor() {
   struct Node *decltor = ParseDecltor();
   if (!decltor) return NULL;
-  struct Node *t;
-  if (!(t = ConsumePunctuator("="))) return decltor;
+  struct Token *t;
+  if (!(t = ConsumePunct(kPunctAssign))) return decltor;
   struct Node *init_expr = ParseAssignExpr();
   assert(init_expr);
   decltor->decltor_init_expr = CreateASTBinOp(t, NULL, init_expr);
@@ -425,7 +431,8 @@ struct Node *ParseParamDecl() {
   struct Node *decl_spec = ParseDeclSpecs();
   if (!decl_spec) return NULL;
   struct Node *n = AllocNode(kASTDecl);
-  n->op = decl_spec;
+  n->op = decl_spec->op;
+  n->left = decl_spec;
   n->right = ParseDecltor();
   return n;
 }
@@ -434,7 +441,8 @@ struct Node *ParseDeclBody() {
   struct Node *decl_spec = ParseDeclSpecs();
   if (!decl_spec) return NULL;
   struct Node *n = AllocNode(kASTDecl);
-  n->op = decl_spec;
+  n->op = decl_spec->op;
+  n->left = decl_spec;
   n->right = ParseInitDecltor();
   return n;
 }
@@ -442,20 +450,20 @@ struct Node *ParseDeclBody() {
 struct Node *ParseDecl() {
   struct Node *decl_body = ParseDeclBody();
   if (!decl_body) return NULL;
-  ExpectPunctuator(";");
+  ExpectPunct(kPunctSemicolon);
   return decl_body;
 }
 
 struct Node *ParseCompStmt() {
-  struct Node *t;
-  if (!(t = ConsumePunctuator("{"))) return NULL;
+  struct Token *t;
+  if (!(t = ConsumePunct(kPunctLBrace))) return NULL;
   struct Node *list = AllocList();
   list->op = t;
   struct Node *stmt;
   while ((stmt = ParseDecl()) || (stmt = ParseStmt())) {
     PushToList(list, stmt);
   }
-  ExpectPunctuator("}");
+  ExpectPunct(kPunctRBrace);
   return list;
 }
 
@@ -465,16 +473,16 @@ struct Node *ParseFuncDef(struct Node *decl_body) {
   return CreateASTFuncDef(decl_body, comp_stmt);
 }
 
-void InitParser(struct Node **head_token) {
-  InitTokenStream(RemoveDelimiterTokens(head_token));
+void InitParser(struct TokenList *tokens) {
+  InitTokenStream(RemoveDelimiterTokens(tokens));
 }
 
-struct Node *Parse(struct Node **head_token) {
-  InitParser(head_token);
+struct Node *Parse(struct TokenList *tokens) {
+  InitParser(tokens);
   struct Node *list = AllocList();
   struct Node *decl_body;
   while ((decl_body = ParseDeclBody())) {
-    if (ConsumePunctuator(";")) {
+    if (ConsumePunct(kPunctSemicolon)) {
       PushToList(list, decl_body);
       continue;
     }
@@ -484,7 +492,7 @@ struct Node *Parse(struct Node **head_token) {
     }
     PushToList(list, func_def);
   }
-  struct Node *t;
+  struct Token *t;
   if (!(t = NextToken())) return list;
   ErrorWithToken(t, "Unexpected token");
 }
@@ -0,0 +1,776 @@
+#include "compilium.h"
+
+// Precompiled headers
+//
+// --emit-pch compiles a header and writes out what the rest of a translation
+// unit can see of it: the macros defined at its end, and the functions and
+// structs declared at its top level together with the nodes they refer to.
+// --include-pch maps such a file once and seeds each compilation with them,
+// instead of preprocessing and parsing the header again.
+//
+// --emit-ast writes the AST of a translation unit after Analyze in the same
+// format, with the root of the AST as its first node and no macros or
+// symbols, but with the size and hash of each header and PCH which the input
+// read. --load-ast reads it back and passes it to Generate directly, unless the
+// input, one of those files or the options which shape the output changed.
+//
+// Nodes and tokens in the file refer to each other by index, so the file can
+// be mapped at any address. Spellings of tokens and names are kept in the
+// text section, which is registered as a source buffer so that tokens loaded
+// from the file point directly into the mapping.
+
+#define PCH_MAGIC 0x48435043  // "CPCH"
+#define AST_MAGIC 0x54534143  // "CAST"
+#define PCH_VERSION 4
+
+struct PCHHeader {
+  int magic;
+  int version;
+  int num_of_tokens;
+  int num_of_nodes;
+  int num_of_refs;
+  int num_of_macros;
+  int num_of_symbols;
+  int num_of_dependencies;
+  int text_size;
+  int source_size;  // of the file which this file was made from
+  unsigned long long source_hash;
+  unsigned long long options_hash;  // of the options given to make this file
+};
+// The sections follow the header in the order of the counts above.
+
+struct PCHToken {
+  int type;
+  int punct;
+  int length;
+  int text_ofs;
+  int has_atom;
+};
+
+#define MAX_NODE_REFS 5
+#define MAX_TOKEN_REFS 2
+
+struct PCHNode {
+  int type;
+  int reg;
+  // Other fields which are not refs, of each type as in struct Node
+  union {
+    int struct_member_ent_ofs;
+    struct {
+      int byte_offset;
+      int label_number;
+    };
+    int stack_size_needed;
+    struct {
+      int nodes_begin;  // index of refs
+      int size;
+    };
+    struct {
+      int key_text_ofs;  // -1 if the node has no key
+      int key_has_atom;
+    };
+    struct {
+      int macro_params_begin;  // index of refs
+      int num_of_macro_params;  // -1 for object-like macros
+      int macro_body_begin;
+      int macro_body_size;  // -1 if the node has no macro body
+    };
+  };
+  // Refs are index + 1, or 0 for NULL.
+  // Fields of each type are listed by GetNodeRefFields and GetTokenRefFields.
+  int node_refs[MAX_NODE_REFS];
+  int token_refs[MAX_TOKEN_REFS];
+};
+
+struct PCHMacro {
+  int name_text_ofs;
+  int replacement;  // index of nodes
+};
+
+struct PCHSymbol {
+  int type;
+  int name_text_ofs;
+  int value;  // index of nodes
+};
+
+struct PCHDependency {
+  int path_text_ofs;
+  int size;
+  unsigned long long hash;
+};
+
+static int GetNodeRefFields(struct Node *n,
+                            struct Node **fields[MAX_NODE_REFS]) {
+  // returns the number of fields of n which refer to nodes. Only fields of the
+  // type of n are returned, since n has no room for the others.
+  int num = 0;
+  fields[num++] = &n->expr_type;
+  switch (n->type) {
+    case kASTExpr:
+      fields[num++] = &n->cond;
+      // fall through
+    case kASTJumpStmt:
+    case kASTDecl:
+    case kTypeLValue:
+    case kTypePointer:
+    case kTypeFunction:
+    case kTypeAttrIdent:
+      fields[num++] = &n->right;
+      // fall through
+    case kASTExprStmt:
+      fields[num++] = &n->left;
+      break;
+    case kASTDirectDecltor:
+      fields[num++] = &n->left;
+      fields[num++] = &n->right;
+      fields[num++] = &n->decltor;
+      break;
+    case kASTDecltor:
+      fields[num++] = &n->left;
+      fields[num++] = &n->right;
+      fields[num++] = &n->decltor_init_expr;
+      break;
+    case kASTSelectionStmt:
+      fields[num++] = &n->cond;
+      fields[num++] = &n->if_true_stmt;
+      fields[num++] = &n->if_else_stmt;
+      break;
+    case kASTForStmt:
+      fields[num++] = &n->init;
+      fields[num++] = &n->updt;
+      // fall through
+    case kASTWhileStmt:
+      fields[num++] = &n->cond;
+      fields[num++] = &n->body;
+      break;
+    case kASTExprFuncCall:
+      fields[num++] = &n->func_expr;
+      fields[num++] = &n->arg_expr_list;
+      break;
+    case kASTFuncDef:
+      fields[num++] = &n->func_body;
+      fields[num++] = &n->func_type;
+      fields[num++] = &n->arg_var_list;
+      break;
+    case kASTKeyValue:
+      fields[num++] = &n->value;
+      break;
+    case kASTStructSpec:
+      fields[num++] = &n->struct_member_dict;
+      break;
+    case kTypeStruct:
+      fields[num++] = &n->type_struct_spec;
+      break;
+    case kNodeStructMember:
+      fields[num++] = &n->struct_member_decl;
+      fields[num++] = &n->struct_member_ent_type;
+      break;
+    case kTypeArray:
+      fields[num++] = &n->type_array_type_of;
+      fields[num++] = &n->type_array_index_decl;
+      break;
+    default:
+      break;
+  }
+  assert(num <= MAX_NODE_REFS);
+  return num;
+}
+
+static int GetTokenRefFields(struct Node *n,
+                             struct Token **fields[MAX_TOKEN_REFS]) {
+  // returns the number of fields of n which refer to tokens.
+  int num = 0;
+  fields[num++] = &n->op;
+  if (n->type == kASTFuncDef) fields[num++] = &n->func_name_token;
+  if (n->type == kASTStructSpec || n->type == kTypeStruct)
+    fields[num++] = &n->tag;
+  return num;
+}
+
+// Writing
+
+struct PCHBuffer {
+  char *data;
+  int size;
+  int capacity;
+};
+
+static int AppendToPCHBuffer(struct PCHBuffer *b, const void *data, int size) {
+  // returns the offset of the appended data.
+  if (b->size + size > b->capacity) {
+    b->capacity = (b->size + size) * 2;
+    b->data = realloc(b->data, b->capacity);
+    assert(b->data);
+  }
+  memcpy(b->data + b->size, data, size);
+  int ofs = b->size;
+  b->size += size;
+  return ofs;
+}
+
+struct PointerIndexMap {
+  const void **keys;
+  int *indices;
+  int size;
+  int num_of_keys;
+};
+
+static int GetPointerIndexSlot(struct PointerIndexMap *m, const void *key) {
+  int mask = m->size - 1;
+  int i = ((unsigned long)key >> 3) * 2654435761u & mask;
+  while (m->keys[i] && m->keys[i] != key) i = (i + 1) & mask;
+  return i;
+}
+
+static int FindOrAddPointerIndex(struct PointerIndexMap *m, const void *key,
+                                 int index_if_new) {
+  // returns the index of key, adding key with index_if_new if it is new.
+  if (m->num_of_keys * 2 >= m->size) {
+    struct PointerIndexMap old = *m;
+    m->size = old.size ? old.size * 2 : 256;
+    m->keys = calloc(m->size, sizeof(const void *));
+    m->indices = calloc(m->size, sizeof(int));
+    assert(m->keys && m->indices);
+    for (int i = 0; i < old.size; i++) {
+      if (!old.keys[i]) continue;
+      int slot = GetPointerIndexSlot(m, old.keys[i]);
+      m->keys[slot] = old.keys[i];
+      m->indices[slot] = old.indices[i];
+    }
+  }
+  int slot = GetPointerIndexSlot(m, key);
+  if (m->keys[slot]) return m->indices[slot];
+  m->keys[slot] = key;
+  m->indices[slot] = index_if_new;
+  m->num_of_keys++;
+  return index_if_new;
+}
+
+struct PCHWriter {
+  struct PCHBuffer tokens;
+  struct PCHBuffer nodes;
+  struct PCHBuffer refs;
+  struct PCHBuffer macros;
+  struct PCHBuffer symbols;
+  struct PCHBuffer dependencies;
+  struct PCHBuffer text;
+  struct PointerIndexMap token_indices;
+  struct PointerIndexMap node_indices;
+  int num_of_tokens;
+  struct Node **node_list;  // nodes in the order of their indices
+  int num_of_nodes;
+  int node_list_capacity;
+};
+
+static int AppendText(struct PCHWriter *w, const char *s, int length) {
+  // returns the offset of the NUL-terminated copy of s[0..length).
+  int ofs = AppendToPCHBuffer(&w->text, s, length);
+  AppendToPCHBuffer(&w->text, "", 1);
+  return ofs;
+}
+
+static void AppendRef(struct PCHWriter *w, int ref) {
+  AppendToPCHBuffer(&w->refs, &ref, sizeof(ref));
+}
+
+static int AddTokenRef(struct PCHWriter *w, struct Token *t) {
+  if (!t) return 0;
+  int index = FindOrAddPointerIndex(&w->token_indices, t, w->num_of_tokens);
+  if (index < w->num_of_tokens) return index + 1;
+  w->num_of_tokens++;
+  struct PCHToken pt;
+  pt.type = t->type;
+  pt.punct = t->punct;
+  pt.length = t->length;
+  pt.text_ofs = AppendText(w, GetTokenBegin(t), t->length);
+  pt.has_atom = t->atom != 0;
+  AppendToPCHBuffer(&w->tokens, &pt, sizeof(pt));
+  return index + 1;
+}
+
+static int AddNodeRef(struct PCHWriter *w, struct Node *n) {
+  // nodes are written later in the order of their indices.
+  if (!n) return 0;
+  int index = FindOrAddPointerIndex(&w->node_indices, n, w->num_of_nodes);
+  if (index < w->num_of_nodes) return index + 1;
+  if (w->num_of_nodes >= w->node_list_capacity) {
+    w->node_list_capacity = (w->node_list_capacity + 1) * 2;
+    w->node_list = realloc(w->node_list,
+                           sizeof(struct Node *) * w->node_list_capacity);
+    assert(w->node_list);
+  }
+  w->node_list[w->num_of_nodes++] = n;
+  return index + 1;
+}
+
+static int AddTokenListRefs(struct PCHWriter *w, struct TokenList *list,
+                            int *size) {
+  // returns the index of refs of the first token. *size is -1 if list is NULL.
+  int begin = w->refs.size / sizeof(int);
+  *size = list ? list->size : -1;
+  for (int i = 0; list && i < list->size; i++) {
+    AppendRef(w, AddTokenRef(w, &list->tokens[i]));
+  }
+  return begin;
+}
+
+static void WriteNode(struct PCHWriter *w, struct Node *n) {
+  struct PCHNode pn = {0};
+  pn.type = n->type;
+  pn.reg = n->reg;
+  if (n->type == kNodeStructMember) {
+    pn.struct_member_ent_ofs = n->struct_member_ent_ofs;
+  } else if (n->type == kASTLocalVar) {
+    pn.byte_offset = n->byte_offset;
+  } else if (n->type == kASTExpr) {
+    pn.byte_offset = n->byte_offset;
+    pn.label_number = n->label_number;
+  } else if (n->type == kASTExprFuncCall) {
+    pn.stack_size_needed = n->stack_size_needed;
+  } else if (n->type == kASTList) {
+    pn.nodes_begin = w->refs.size / sizeof(int);
+    pn.size = n->size;
+    for (int i = 0; i < n->size; i++) {
+      AppendRef(w, AddNodeRef(w, n->nodes[i]));
+    }
+  } else if (n->type == kASTKeyValue) {
+    pn.key_text_ofs = n->key ? AppendText(w, n->key, strlen(n->key)) : -1;
+    pn.key_has_atom = n->key_atom != 0;
+  } else if (n->type == kNodeMacroReplacement) {
+    pn.macro_params_begin =
+        AddTokenListRefs(w, n->macro_params, &pn.num_of_macro_params);
+    pn.macro_body_begin =
+        AddTokenListRefs(w, n->macro_body, &pn.macro_body_size);
+  }
+  struct Node **node_fields[MAX_NODE_REFS];
+  int num_of_node_fields = GetNodeRefFields(n, node_fields);
+  for (int i = 0; i < num_of_node_fields; i++) {
+    pn.node_refs[i] = AddNodeRef(w, *node_fields[i]);
+  }
+  struct Token **token_fields[MAX_TOKEN_REFS];
+  int num_of_token_fields = GetTokenRefFields(n, token_fields);
+  for (int i = 0; i < num_of_token_fields; i++) {
+    pn.token_refs[i] = AddTokenRef(w, *token_fields[i]);
+  }
+  AppendToPCHBuffer(&w->nodes, &pn, sizeof(pn));
+}
+
+static void AddMacros(struct PCHWriter *w) {
+  for (int slot = 0; slot < compilation->macro_table_size; slot++) {
+    int atom;
+    struct Node *replacement = GetMacroInSlot(slot, &atom);
+    if (!replacement) continue;
+    struct PCHMacro pm;
+    const char *name = GetAtomStr(atom);
+    pm.name_text_ofs = AppendText(w, name, strlen(name));
+    pm.replacement = AddNodeRef(w, replacement) - 1;
+    AppendToPCHBuffer(&w->macros, &pm, sizeof(pm));
+  }
+}
+
+static void AddSymbols(struct PCHWriter *w, struct SymbolEntry *symbols) {
+  // symbols declared after the prelude are added, the oldest first.
+  int num_of_symbols = 0;
+  for (struct SymbolEntry *e = symbols; e != compilation->prelude_symbols;
+       e = GetPrevSymbol(e))
+    num_of_symbols++;
+  struct SymbolEntry **list =
+      calloc(num_of_symbols, sizeof(struct SymbolEntry *));
+  int i = num_of_symbols;
+  for (struct SymbolEntry *e = symbols; e != compilation->prelude_symbols;
+       e = GetPrevSymbol(e))
+    list[--i] = e;
+  for (i = 0; i < num_of_symbols; i++) {
+    enum SymbolType type = GetSymbolType(list[i]);
+    const char *name = GetAtomStr(GetSymbolAtom(list[i]));
+    if (type != kSymbolFuncDeclType && type != kSymbolStructType)
+      Error("Only declarations of functions and structs can be precompiled, "
+            "but %s is not",
+            name);
+    struct PCHSymbol ps;
+    ps.type = type;
+    ps.name_text_ofs = AppendText(w, name, strlen(name));
+    ps.value = AddNodeRef(w, GetSymbolValue(list[i])) - 1;
+    AppendToPCHBuffer(&w->symbols, &ps, sizeof(ps));
+  }
+}
+
+static void AddDependencies(struct PCHWriter *w) {
+  // The input itself is checked by its hash, wherever it is read from.
+  for (int i = 0; i < compilation->num_of_dependencies; i++) {
+    struct PCHDependency pd;
+    const char *dep_path = GetDependency(i, &pd.size, &pd.hash);
+    if (!dep_path || dep_path == compilation->input_path) continue;
+    pd.path_text_ofs = AppendText(w, dep_path, strlen(dep_path));
+    AppendToPCHBuffer(&w->dependencies, &pd, sizeof(pd));
+  }
+}
+
+static void WritePCHSection(FILE *fp, struct PCHBuffer *b, const char *path) {
+  if (b->size && fwrite(b->data, b->size, 1, fp) != 1)
+    Error("Failed to write %s", path);
+}
+
+static void WritePCHFile(struct PCHWriter *w, const char *path, int magic,
+                         const char *source) {
+  // writes the nodes added to w and everything they refer to.
+  // Writing a node may add more nodes to the end of the list.
+  for (int i = 0; i < w->num_of_nodes; i++) {
+    WriteNode(w, w->node_list[i]);
+  }
+
+  struct PCHHeader h;
+  h.magic = magic;
+  h.version = PCH_VERSION;
+  h.num_of_tokens = w->num_of_tokens;
+  h.num_of_nodes = w->num_of_nodes;
+  h.num_of_refs = w->refs.size / sizeof(int);
+  h.num_of_macros = w->macros.size / sizeof(struct PCHMacro);
+  h.num_of_symbols = w->symbols.size / sizeof(struct PCHSymbol);
+  h.num_of_dependencies = w->dependencies.size / sizeof(struct PCHDependency);
+  h.text_size = w->text.size;
+  h.source_size = strlen(source);
+  h.source_hash = HashContents(source, h.source_size);
+  h.options_hash = GetOutputOptionsHash();
+
+  FILE *fp = fopen(path, "wb");
+  if (!fp) Error("Failed to open %s", path);
+  if (fwrite(&h, sizeof(h), 1, fp) != 1) Error("Failed to write %s", path);
+  WritePCHSection(fp, &w->tokens, path);
+  WritePCHSection(fp, &w->nodes, path);
+  WritePCHSection(fp, &w->refs, path);
+  WritePCHSection(fp, &w->macros, path);
+  WritePCHSection(fp, &w->symbols, path);
+  WritePCHSection(fp, &w->dependencies, path);
+  WritePCHSection(fp, &w->text, path);
+  fclose(fp);
+}
+
+void EmitPrecompiledHeader(const char *path) {
+  const char *input = ReadInput(compilation->input_path);
+  LoadPrecompiledHeader();
+  struct Node *ast = Parse(Preprocess(input));
+  struct SymbolEntry *symbols = Analyze(ast);
+
+  struct PCHWriter w = {0};
+  AddMacros(&w);
+  AddSymbols(&w, symbols);
+  WritePCHFile(&w, path, PCH_MAGIC, input);
+}
+
+void EmitASTFile(const char *path, struct Node *ast, const char *input) {
+  // ast should be analyzed. input is the source which ast was made from.
+  struct PCHWriter w = {0};
+  AddNodeRef(&w, ast);
+  AddDependencies(&w);
+  WritePCHFile(&w, path, AST_MAGIC, input);
+}
+
+// Reading
+
+static const char *pch_path;
+static const char *pch_image;  // shared by all compilations
+
+static const int *GetPCHRefs(const struct PCHHeader *h) {
+  const struct PCHToken *ptokens = (const struct PCHToken *)(h + 1);
+  const struct PCHNode *pnodes =
+      (const struct PCHNode *)(ptokens + h->num_of_tokens);
+  return (const int *)(pnodes + h->num_of_nodes);
+}
+
+static const struct PCHMacro *GetPCHMacros(const struct PCHHeader *h) {
+  return (const struct PCHMacro *)(GetPCHRefs(h) + h->num_of_refs);
+}
+
+static const struct PCHDependency *GetPCHDependencies(
+    const struct PCHHeader *h) {
+  const struct PCHSymbol *psymbols =
+      (const struct PCHSymbol *)(GetPCHMacros(h) + h->num_of_macros);
+  return (const struct PCHDependency *)(psymbols + h->num_of_symbols);
+}
+
+static const char *GetPCHText(const struct PCHHeader *h) {
+  return (const char *)(GetPCHDependencies(h) + h->num_of_dependencies);
+}
+
+static const char *ReadPCHImage(const char *path, int *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) Error("Failed to open %s", path);
+  off_t file_size = lseek(fd, 0, SEEK_END);
+  close(fd);
+  if (file_size < 0 || file_size > 0x7fffffff)
+    Error("Failed to get size of %s", path);
+  *size = file_size;
+  return ReadInput(path);
+}
+
+static bool IsValidIndex(int index, int num) {
+  return 0 <= index && index < num;
+}
+
+static bool IsValidRef(int ref, int num) {
+  // refs are index + 1, or 0 for NULL.
+  return 0 <= ref && ref <= num;
+}
+
+static bool AreValidRefs(const struct PCHHeader *h, int begin, int size,
+                         int min_ref, int num) {
+  // returns true if refs[begin..begin+size) are all in [min_ref, num].
+  const int *refs = GetPCHRefs(h);
+  if (begin < 0 || size < 0 || begin > h->num_of_refs - size) return false;
+  for (int i = begin; i < begin + size; i++) {
+    if (refs[i] < min_ref || refs[i] > num) return false;
+  }
+  return true;
+}
+
+static bool IsValidPCHNode(const struct PCHHeader *h,
+                           const struct PCHNode *pn) {
+  if (!IsValidIndex(pn->type, kNumOfNodeTypes)) return false;
+  for (int i = 0; i < MAX_NODE_REFS; i++) {
+    if (!IsValidRef(pn->node_refs[i], h->num_of_nodes)) return false;
+  }
+  for (int i = 0; i < MAX_TOKEN_REFS; i++) {
+    if (!IsValidRef(pn->token_refs[i], h->num_of_tokens)) return false;
+  }
+  if (pn->type == kASTList)
+    return AreValidRefs(h, pn->nodes_begin, pn->size, 0, h->num_of_nodes);
+  if (pn->type == kASTKeyValue)
+    return pn->key_text_ofs == -1 ||
+           IsValidIndex(pn->key_text_ofs, h->text_size);
+  if (pn->type == kNodeMacroReplacement) {
+    // Tokens in macros are never NULL.
+    return (pn->num_of_macro_params == -1 ||
+            AreValidRefs(h, pn->macro_params_begin, pn->num_of_macro_params, 1,
+                         h->num_of_tokens)) &&
+           (pn->macro_body_size == -1 ||
+            AreValidRefs(h, pn->macro_body_begin, pn->macro_body_size, 1,
+                         h->num_of_tokens));
+  }
+  return true;
+}
+
+static bool AreValidPCHSections(const struct PCHHeader *h, int size) {
+  // returns true if the sections fill the rest of the file exactly and every
+  // index and offset in them stays inside its section.
+  if (h->num_of_tokens < 0 || h->num_of_nodes < 0 || h->num_of_refs < 0 ||
+      h->num_of_macros < 0 || h->num_of_symbols < 0 ||
+      h->num_of_dependencies < 0 || h->text_size < 0)
+    return false;
+  long long sections_size =
+      (long long)h->num_of_tokens * sizeof(struct PCHToken) +
+      (long long)h->num_of_nodes * sizeof(struct PCHNode) +
+      (long long)h->num_of_refs * sizeof(int) +
+      (long long)h->num_of_macros * sizeof(struct PCHMacro) +
+      (long long)h->num_of_symbols * sizeof(struct PCHSymbol) +
+      (long long)h->num_of_dependencies * sizeof(struct PCHDependency) +
+      h->text_size;
+  if (sections_size != size - (long long)sizeof(*h)) return false;
+  // Every string in the text section is NUL-terminated.
+  const char *text = GetPCHText(h);
+  if (h->text_size && text[h->text_size - 1]) return false;
+  const struct PCHToken *ptokens = (const struct PCHToken *)(h + 1);
+  for (int i = 0; i < h->num_of_tokens; i++) {
+    const struct PCHToken *pt = &ptokens[i];
+    if (!IsValidIndex(pt->type, kNumOfTokenTypes) ||
+        !IsValidIndex(pt->punct, kNumOfPuncts) || pt->length < 0 ||
+        pt->text_ofs < 0 || pt->text_ofs > h->text_size - pt->length)
+      return false;
+  }
+  const struct PCHNode *pnodes =
+      (const struct PCHNode *)(ptokens + h->num_of_tokens);
+  for (int i = 0; i < h->num_of_nodes; i++) {
+    if (!IsValidPCHNode(h, &pnodes[i])) return false;
+  }
+  const struct PCHMacro *pmacros = GetPCHMacros(h);
+  for (int i = 0; i < h->num_of_macros; i++) {
+    if (!IsValidIndex(pmacros[i].name_text_ofs, h->text_size) ||
+        !IsValidIndex(pmacros[i].replacement, h->num_of_nodes) ||
+        pnodes[pmacros[i].replacement].type != kNodeMacroReplacement)
+      return false;
+  }
+  const struct PCHSymbol *psymbols =
+      (const struct PCHSymbol *)(pmacros + h->num_of_macros);
+  for (int i = 0; i < h->num_of_symbols; i++) {
+    if ((psymbols[i].type != kSymbolFuncDeclType &&
+         psymbols[i].type != kSymbolStructType) ||
+        !IsValidIndex(psymbols[i].name_text_ofs, h->text_size) ||
+        !IsValidIndex(psymbols[i].value, h->num_of_nodes))
+      return false;
+  }
+  const struct PCHDependency *pdeps = GetPCHDependencies(h);
+  for (int i = 0; i < h->num_of_dependencies; i++) {
+    if (!IsValidIndex(pdeps[i].path_text_ofs, h->text_size)) return false;
+  }
+  return true;
+}
+
+static const struct PCHHeader *CheckPCHHeader(const char *image, int size,
+                                              const char *path, int magic) {
+  // returns the header of image, which is size bytes long, after checking
+  // that the sections which it describes are inside the image.
+  const struct PCHHeader *h = (const struct PCHHeader *)image;
+  if (size < (int)sizeof(*h) || h->magic != magic ||
+      h->version != PCH_VERSION)
+    Error("%s is not a %s of this version", path,
+          magic == PCH_MAGIC ? "precompiled header" : "AST file");
+  // The root of an AST is its first node.
+  if (!AreValidPCHSections(h, size) ||
+      (magic == AST_MAGIC && h->num_of_nodes < 1))
+    Error("%s is corrupted", path);
+  return h;
+}
+
+void MapPrecompiledHeader(const char *path) {
+  pch_path = path;
+  int size;
+  pch_image = ReadPCHImage(path, &size);
+  CheckPCHHeader(pch_image, size, path, PCH_MAGIC);
+}
+
+static struct TokenList *CreateTokenListFromRefs(const int *refs, int size,
+                                                 struct Token *tokens) {
+  if (size < 0) return NULL;
+  struct TokenList *list = AllocTokenList();
+  for (int i = 0; i < size; i++) {
+    PushTokenToList(list, &tokens[refs[i] - 1]);
+  }
+  return list;
+}
+
+static void ReadNode(struct Node *n, const struct PCHNode *pn,
+                     struct Node **nodes, struct Token *tokens,
+                     const int *refs, const char *text) {
+  n->reg = pn->reg;
+  if (n->type == kNodeStructMember) {
+    n->struct_member_ent_ofs = pn->struct_member_ent_ofs;
+  } else if (n->type == kASTLocalVar) {
+    n->byte_offset = pn->byte_offset;
+  } else if (n->type == kASTExpr) {
+    n->byte_offset = pn->byte_offset;
+    n->label_number = pn->label_number;
+  } else if (n->type == kASTExprFuncCall) {
+    n->stack_size_needed = pn->stack_size_needed;
+  } else if (n->type == kASTList && pn->size) {
+    n->nodes = malloc(sizeof(struct Node *) * pn->size);
+    assert(n->nodes);
+    for (int i = 0; i < pn->size; i++) {
+      n->nodes[i] = nodes[refs[pn->nodes_begin + i] - 1];
+    }
+    n->size = n->capacity = pn->size;
+  } else if (n->type == kASTKeyValue && pn->key_text_ofs >= 0) {
+    n->key = &text[pn->key_text_ofs];
+    if (pn->key_has_atom) n->key_atom = InternAtom(n->key, strlen(n->key));
+  } else if (n->type == kNodeMacroReplacement) {
+    n->macro_params = CreateTokenListFromRefs(
+        &refs[pn->macro_params_begin], pn->num_of_macro_params, tokens);
+    n->macro_body = CreateTokenListFromRefs(&refs[pn->macro_body_begin],
+                                            pn->macro_body_size, tokens);
+  }
+  struct Node **node_fields[MAX_NODE_REFS];
+  int num_of_node_fields = GetNodeRefFields(n, node_fields);
+  for (int i = 0; i < num_of_node_fields; i++) {
+    int ref = pn->node_refs[i];
+    *node_fields[i] = ref ? nodes[ref - 1] : NULL;
+  }
+  struct Token **token_fields[MAX_TOKEN_REFS];
+  int num_of_token_fields = GetTokenRefFields(n, token_fields);
+  for (int i = 0; i < num_of_token_fields; i++) {
+    int ref = pn->token_refs[i];
+    *token_fields[i] = ref ? &tokens[ref - 1] : NULL;
+  }
+}
+
+static struct Node **ReadPCHNodes(const char *image, const char *path) {
+  // returns the nodes of the mapped file, whose tokens point into the image.
+  const struct PCHHeader *h = (const struct PCHHeader *)image;
+  const struct PCHToken *ptokens = (const struct PCHToken *)(h + 1);
+  const struct PCHNode *pnodes =
+      (const struct PCHNode *)(ptokens + h->num_of_tokens);
+  const int *refs = (const int *)(pnodes + h->num_of_nodes);
+  const char *text = GetPCHText(h);
+
+  unsigned text_loc = AddSourceBuffer(path, text, h->text_size);
+  // The text section is the last one of the file.
+  AddDependency(path, image, text + h->text_size - image);
+  struct Token *tokens =
+      AllocFromArena(sizeof(struct Token) * h->num_of_tokens);
+  for (int i = 0; i < h->num_of_tokens; i++) {
+    const struct PCHToken *pt = &ptokens[i];
+    tokens[i].type = pt->type;
+    tokens[i].punct = pt->punct;
+    tokens[i].length = pt->length;
+    tokens[i].loc = text_loc + pt->text_ofs;
+    if (pt->has_atom)
+      tokens[i].atom = InternAtom(&text[pt->text_ofs], pt->length);
+  }
+  struct Node **nodes = AllocFromArena(sizeof(struct Node *) * h->num_of_nodes);
+  for (int i = 0; i < h->num_of_nodes; i++) {
+    nodes[i] = AllocNode(pnodes[i].type);
+  }
+  for (int i = 0; i < h->num_of_nodes; i++) {
+    ReadNode(nodes[i], &pnodes[i], nodes, tokens, refs, text);
+  }
+  return nodes;
+}
+
+void LoadPrecompiledHeader(void) {
+  // defines the macros and declares the symbols of the mapped header.
+  if (!pch_image) return;
+  const struct PCHHeader *h = (const struct PCHHeader *)pch_image;
+  const struct PCHMacro *pmacros = GetPCHMacros(h);
+  const struct PCHSymbol *psymbols =
+      (const struct PCHSymbol *)(pmacros + h->num_of_macros);
+  const char *text = GetPCHText(h);
+  struct Node **nodes = ReadPCHNodes(pch_image, pch_path);
+  for (int i = 0; i < h->num_of_macros; i++) {
+    const char *name = &text[pmacros[i].name_text_ofs];
+    struct Token name_token = {.atom = InternAtom(name, strlen(name))};
+    DefineMacro(&name_token, nodes[pmacros[i].replacement]);
+  }
+  for (int i = 0; i < h->num_of_symbols; i++) {
+    const char *name = &text[psymbols[i].name_text_ofs];
+    struct Token name_token = {.atom = InternAtom(name, strlen(name))};
+    struct Node *value = nodes[psymbols[i].value];
+    if (psymbols[i].type == kSymbolFuncDeclType) {
+      AddFuncDeclType(&compilation->prelude_symbols, &name_token, value);
+    } else {
+      assert(psymbols[i].type == kSymbolStructType);
+      AddStructType(&compilation->prelude_symbols, &name_token, value);
+    }
+  }
+}
+
+static bool IsASTFileUpToDate(const struct PCHHeader *h) {
+  // returns true if the files which the AST was made from are unchanged and
+  // the options which shape the output are the same.
+  if (h->options_hash != GetOutputOptionsHash()) return false;
+  const struct PCHDependency *pdeps = GetPCHDependencies(h);
+  const char *text = GetPCHText(h);
+  for (int i = 0; i < h->num_of_dependencies; i++) {
+    if (!IsFileUnchanged(&text[pdeps[i].path_text_ofs], pdeps[i].size,
+                         pdeps[i].hash))
+      return false;
+  }
+  return true;
+}
+
+struct Node *LoadASTFile(const char *path, const char *input) {
+  // returns the AST in path, or NULL if it was made from other than input.
+  // The AST is returned regardless of its source if input is NULL, but not
+  // if it is out of date, since there is nothing to compile instead.
+  int image_size;
+  const char *image = ReadPCHImage(path, &image_size);
+  const struct PCHHeader *h =
+      CheckPCHHeader(image, image_size, path, AST_MAGIC);
+  if (input) {
+    int size = strlen(input);
+    if (size != h->source_size || HashContents(input, size) != h->source_hash)
+      return NULL;
+  }
+  if (!IsASTFileUpToDate(h)) {
+    if (!input) Error("%s is out of date", path);
+    return NULL;
+  }
+  return ReadPCHNodes(image, path)[0];
+}
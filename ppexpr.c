@@ -0,0 +1,243 @@
+#include "compilium.h"
+
+// Evaluation of constant expressions of #if and #elif. Macros and defined
+// operators should be replaced before evaluation, so identifiers left in the
+// expression are evaluated as 0. Operands which are not evaluated, such as
+// the right of 0 && x, are parsed but can not raise errors of evaluation.
+
+struct PPExprReader {
+  struct TokenList *tokens;
+  int pos;
+  int unevaluated_depth;  // > 0 while reading an operand not evaluated
+};
+
+static struct Token *PeekPPExprToken(struct PPExprReader *r) {
+  if (r->pos >= r->tokens->size) return NULL;
+  return &r->tokens->tokens[r->pos];
+}
+
+static struct Token *ConsumePPExprPunct(struct PPExprReader *r,
+                                        enum PunctuatorType punct) {
+  struct Token *t = PeekPPExprToken(r);
+  if (!IsPunctToken(t, punct)) return NULL;
+  r->pos++;
+  return t;
+}
+
+static struct Token *ExpectPPExprPunct(struct PPExprReader *r,
+                                       enum PunctuatorType punct) {
+  struct Token *t = ConsumePPExprPunct(r, punct);
+  if (t) return t;
+  const char *s = GetPunctuatorStr(punct);
+  t = PeekPPExprToken(r);
+  if (!t) Error("Expected %s at the end of #if", s);
+  ErrorWithToken(t, "Expected %s here", s);
+}
+
+static long EvalCharLiteral(struct Token *t) {
+  const char *s = GetTokenBegin(t);
+  if (s[1] != '\\') return s[1];
+  if (s[2] == 'n') return '\n';
+  if (s[2] == 't') return '\t';
+  if (s[2] == '0') return 0;
+  return s[2];
+}
+
+static bool IsIntegerSuffix(struct Token *number, struct Token *t) {
+  // The tokenizer splits 1UL into 1 and UL.
+  if (!IsTokenWithType(t, kTokenIdent)) return false;
+  if (t->loc != number->loc + number->length) return false;
+  const char *s = GetTokenBegin(t);
+  for (int i = 0; i < t->length; i++) {
+    if (s[i] != 'u' && s[i] != 'U' && s[i] != 'l' && s[i] != 'L')
+      return false;
+  }
+  return true;
+}
+
+static long EvalPPConditionalExpr(struct PPExprReader *r);
+
+static long EvalPPPrimaryExpr(struct PPExprReader *r) {
+  struct Token *t = PeekPPExprToken(r);
+  if (!t) Error("Expected an expression at the end of #if");
+  r->pos++;
+  if (IsTokenWithType(t, kTokenDecimalNumber) ||
+      IsTokenWithType(t, kTokenOctalNumber)) {
+    if (IsIntegerSuffix(t, PeekPPExprToken(r))) r->pos++;
+    return strtol(GetTokenBegin(t), NULL, 0);
+  }
+  if (IsTokenWithType(t, kTokenCharLiteral)) return EvalCharLiteral(t);
+  if (t->atom) return 0;
+  if (IsPunctToken(t, kPunctLParen)) {
+    long v = EvalPPConditionalExpr(r);
+    ExpectPPExprPunct(r, kPunctRParen);
+    return v;
+  }
+  ErrorWithToken(t, "Not a constant expression");
+}
+
+static long EvalPPUnaryExpr(struct PPExprReader *r) {
+  if (ConsumePPExprPunct(r, kPunctPlus)) return EvalPPUnaryExpr(r);
+  if (ConsumePPExprPunct(r, kPunctMinus)) return -EvalPPUnaryExpr(r);
+  if (ConsumePPExprPunct(r, kPunctTilde)) return ~EvalPPUnaryExpr(r);
+  if (ConsumePPExprPunct(r, kPunctExcl)) return !EvalPPUnaryExpr(r);
+  return EvalPPPrimaryExpr(r);
+}
+
+static int GetPPBinaryOpPrecedence(struct Token *t) {
+  // returns 0 if t is not a binary operator.
+  switch (t ? t->punct : kPunctNone) {
+    case kPunctStar:
+    case kPunctSlash:
+    case kPunctPercent:
+      return 10;
+    case kPunctPlus:
+    case kPunctMinus:
+      return 9;
+    case kPunctLShift:
+    case kPunctRShift:
+      return 8;
+    case kPunctLt:
+    case kPunctGt:
+    case kPunctLtEq:
+    case kPunctGtEq:
+      return 7;
+    case kPunctEq:
+    case kPunctNotEq:
+      return 6;
+    case kPunctAmp:
+      return 5;
+    case kPunctCaret:
+      return 4;
+    case kPunctBar:
+      return 3;
+    case kPunctAmpAmp:
+      return 2;
+    case kPunctBarBar:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static long EvalPPBinaryOp(struct PPExprReader *reader, struct Token *op,
+                           long l, long r) {
+  switch (op->punct) {
+    case kPunctStar:
+      return l * r;
+    case kPunctSlash:
+    case kPunctPercent:
+      if (!r) {
+        if (reader->unevaluated_depth) return 0;
+        ErrorWithToken(op, "Division by zero in #if");
+      }
+      return op->punct == kPunctSlash ? l / r : l % r;
+    case kPunctPlus:
+      return l + r;
+    case kPunctMinus:
+      return l - r;
+    case kPunctLShift:
+      return l << r;
+    case kPunctRShift:
+      return l >> r;
+    case kPunctLt:
+      return l < r;
+    case kPunctGt:
+      return l > r;
+    case kPunctLtEq:
+      return l <= r;
+    case kPunctGtEq:
+      return l >= r;
+    case kPunctEq:
+      return l == r;
+    case kPunctNotEq:
+      return l != r;
+    case kPunctAmp:
+      return l & r;
+    case kPunctCaret:
+      return l ^ r;
+    case kPunctBar:
+      return l | r;
+    case kPunctAmpAmp:
+      return l && r;
+    case kPunctBarBar:
+      return l || r;
+    default:
+      assert(false);
+  }
+}
+
+static long EvalPPBinaryExpr(struct PPExprReader *r, int min_precedence) {
+  // evaluates operators of min_precedence or higher, left to right.
+  long v = EvalPPUnaryExpr(r);
+  struct Token *op;
+  int precedence;
+  while ((precedence = GetPPBinaryOpPrecedence(op = PeekPPExprToken(r))) >=
+         min_precedence) {
+    r->pos++;
+    // The right of && and || is not evaluated if the left decides the value.
+    bool is_skipped = (op->punct == kPunctAmpAmp && !v) ||
+                      (op->punct == kPunctBarBar && v);
+    r->unevaluated_depth += is_skipped;
+    long rhs = EvalPPBinaryExpr(r, precedence + 1);
+    r->unevaluated_depth -= is_skipped;
+    v = EvalPPBinaryOp(r, op, v, rhs);
+  }
+  return v;
+}
+
+static long EvalPPConditionalExpr(struct PPExprReader *r) {
+  long cond = EvalPPBinaryExpr(r, 1);
+  if (!ConsumePPExprPunct(r, kPunctQuestion)) return cond;
+  r->unevaluated_depth += !cond;
+  long if_true = EvalPPConditionalExpr(r);
+  r->unevaluated_depth -= !cond;
+  ExpectPPExprPunct(r, kPunctColon);
+  r->unevaluated_depth += !!cond;
+  long if_false = EvalPPConditionalExpr(r);
+  r->unevaluated_depth -= !!cond;
+  return cond ? if_true : if_false;
+}
+
+long EvalPreprocessorExpr(struct TokenList *tokens) {
+  // tokens should not have delimiters.
+  struct PPExprReader r = {tokens, 0, 0};
+  long v = EvalPPConditionalExpr(&r);
+  struct Token *t = PeekPPExprToken(&r);
+  if (t) ErrorWithToken(t, "Unexpected token in #if");
+  return v;
+}
+
+static long EvalPreprocessorExprStr(const char *s) {
+  return EvalPreprocessorExpr(RemoveDelimiterTokens(Tokenize(s)));
+}
+
+void TestPPExpr() {
+  fprintf(stderr, "Testing PPExpr...");
+
+  assert(EvalPreprocessorExprStr("0") == 0);
+  assert(EvalPreprocessorExprStr("1") == 1);
+  assert(EvalPreprocessorExprStr("010") == 8);
+  assert(EvalPreprocessorExprStr("1UL") == 1);
+  assert(EvalPreprocessorExprStr("'A'") == 65);
+  assert(EvalPreprocessorExprStr("1 + 2 * 3") == 7);
+  assert(EvalPreprocessorExprStr("(1 + 2) * 3") == 9);
+  assert(EvalPreprocessorExprStr("10 - 3 - 2") == 5);
+  assert(EvalPreprocessorExprStr("-1 < 0") == 1);
+  assert(EvalPreprocessorExprStr("!0 && ~0") == 1);
+  assert(EvalPreprocessorExprStr("1 << 4 | 1") == 17);
+  assert(EvalPreprocessorExprStr("2 == 2 && 3 != 3") == 0);
+  assert(EvalPreprocessorExprStr("0 || 7 % 4 == 3") == 1);
+  assert(EvalPreprocessorExprStr("1 ? 2 : 3") == 2);
+  assert(EvalPreprocessorExprStr("0 ? 2 : 0 ? 3 : 4") == 4);
+  assert(EvalPreprocessorExprStr("UNDEFINED_NAME") == 0);
+  assert(EvalPreprocessorExprStr("UNDEFINED_NAME + 1") == 1);
+  assert(EvalPreprocessorExprStr("0 && 10 / 0") == 0);
+  assert(EvalPreprocessorExprStr("1 || 10 % 0") == 1);
+  assert(EvalPreprocessorExprStr("1 ? 2 : 1 / 0") == 2);
+  assert(EvalPreprocessorExprStr("0 ? 1 / 0 : 3") == 3);
+  assert(EvalPreprocessorExprStr("0 && (1 || 1 / 0)") == 0);
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
+}
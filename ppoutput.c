@@ -0,0 +1,173 @@
+#include "compilium.h"
+
+// Writer of -E output. Tokens lexed from a source buffer are written directly
+// from the buffer, and runs of tokens which are contiguous in memory are
+// merged into one span, so unmodified input is written by a few large writev
+// calls. Short spans are copied into a small text buffer, where they are merged
+// with the text around them instead of costing an iovec each.
+//
+// Line markers (# line "file") are written when the output moves to another
+// file or jumps over lines, e.g. after directives or inactive groups. Small
+// jumps within a file are filled with newlines instead.
+
+#define PP_OUTPUT_MAX_IOV 1024
+#define PP_OUTPUT_TEXT_SIZE 4096
+#define PP_OUTPUT_MIN_SPAN_LENGTH 32
+#define PP_OUTPUT_MAX_NEWLINES_FOR_SYNC 8
+
+struct PPOutput {
+  int fd;
+  bool has_line_markers;
+  struct iovec iov[PP_OUTPUT_MAX_IOV];
+  int num_of_iov;
+  char text[PP_OUTPUT_TEXT_SIZE];
+  int text_size;
+  const char *span_begin;  // span which may be extended by the next write
+  const char *span_end;
+  bool has_position;  // false until the first line marker
+  const char *path;
+  int line;  // line in path of the line being written
+  bool is_line_begin;
+};
+
+static void WriteIovecs(int fd, struct iovec *iov, int n) {
+  while (n) {
+    ssize_t written = writev(fd, iov, n);
+    if (written < 0) Error("Failed to write preprocessed output");
+    while (n && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (!n) break;
+    iov->iov_base = (char *)iov->iov_base + written;
+    iov->iov_len -= written;
+  }
+}
+
+static const char stdin_path[] = "<stdin>";
+
+static void PushSpan(struct PPOutput *w) {
+  // moves the current span to the iovecs, which should have room for it.
+  if (w->span_begin == w->span_end) return;
+  w->iov[w->num_of_iov].iov_base = (void *)w->span_begin;
+  w->iov[w->num_of_iov].iov_len = w->span_end - w->span_begin;
+  w->num_of_iov++;
+  w->span_begin = w->span_end = NULL;
+}
+
+static void FlushPPOutputBuffers(struct PPOutput *w) {
+  PushSpan(w);
+  WriteIovecs(w->fd, w->iov, w->num_of_iov);
+  w->num_of_iov = 0;
+  w->text_size = 0;
+}
+
+static void WriteSpan(struct PPOutput *w, const char *begin, int length) {
+  // begin[0..length) should stay valid until the output is flushed, unless
+  // length is less than PP_OUTPUT_MIN_SPAN_LENGTH.
+  if (!length) return;
+  if (begin == w->span_end) {
+    w->span_end += length;
+    return;
+  }
+  if (length < PP_OUTPUT_MIN_SPAN_LENGTH) {
+    if (w->text_size + length > PP_OUTPUT_TEXT_SIZE ||
+        w->num_of_iov + 1 >= PP_OUTPUT_MAX_IOV)
+      FlushPPOutputBuffers(w);
+    char *copied = &w->text[w->text_size];
+    memcpy(copied, begin, length);
+    w->text_size += length;
+    begin = copied;
+    if (begin == w->span_end) {
+      w->span_end += length;
+      return;
+    }
+  } else if (w->num_of_iov + 1 >= PP_OUTPUT_MAX_IOV) {
+    FlushPPOutputBuffers(w);
+  }
+  PushSpan(w);
+  w->span_begin = begin;
+  w->span_end = begin + length;
+}
+
+static void WriteLineMarker(struct PPOutput *w, const char *path, int line) {
+  char s[32];  // short enough to be copied by WriteSpan
+  snprintf(s, sizeof(s), "# %d \"", line);
+  WriteSpan(w, s, strlen(s));
+  WriteSpan(w, path, strlen(path));
+  WriteSpan(w, "\"\n", 2);
+  w->has_position = true;
+  w->path = path;
+  w->line = line;
+}
+
+static void SyncLine(struct PPOutput *w, unsigned loc) {
+  // makes the line being written correspond to the line of loc.
+  const char *path = GetSourcePath(loc);
+  int line = GetSourceLine(loc);
+  if (!path) path = stdin_path;
+  if (!w->has_position || path != w->path || line < w->line ||
+      line - w->line > PP_OUTPUT_MAX_NEWLINES_FOR_SYNC) {
+    WriteLineMarker(w, path, line);
+    return;
+  }
+  for (; w->line < line; w->line++) WriteSpan(w, "\n", 1);
+}
+
+void BeginPreprocessedOutput(bool has_line_markers) {
+  struct PPOutput *w = compilation->pp_output;
+  if (!w) {
+    w = compilation->pp_output = malloc(sizeof(struct PPOutput));
+    assert(w);
+  }
+  // Tokens are written to the fd directly, after anything written by stdio.
+  fflush(compilation->output);
+  w->fd = fileno(compilation->output);
+  w->has_line_markers = has_line_markers;
+  w->num_of_iov = 0;
+  w->text_size = 0;
+  w->span_begin = w->span_end = NULL;
+  w->has_position = false;
+  w->path = NULL;
+  w->line = 0;
+  w->is_line_begin = true;
+}
+
+void WritePreprocessedToken(struct Token *t, unsigned origin_loc) {
+  // origin_loc is the location in the source which t is written for.
+  struct PPOutput *w = compilation->pp_output;
+  if (t->type == kTokenZeroWidthNoBreakSpace) return;
+  const char *s = GetTokenBegin(t);
+  if (w->has_line_markers && w->is_line_begin) SyncLine(w, origin_loc);
+  if (t->type == kTokenDelimiter && s[0] == '/') {
+    // A comment is written as a space, or as the newline after it.
+    bool is_end_of_line = IsEndOfLineToken(t);
+    WriteSpan(w, is_end_of_line ? "\n" : " ", 1);
+    w->line += is_end_of_line;
+    w->is_line_begin = is_end_of_line;
+    return;
+  }
+  if (t->type != kTokenDelimiter) {
+    WriteSpan(w, s, t->length);
+    w->is_line_begin = false;
+    return;
+  }
+  // A run of spaces may end with a newline followed by the indentation of the
+  // next line, which is written as the beginning of that line.
+  const char *nl = memchr(s, '\n', t->length);
+  int length = nl ? nl + 1 - s : t->length;
+  WriteSpan(w, s, length);
+  w->line += nl != NULL;
+  w->is_line_begin = nl != NULL;
+  if (length == t->length) return;
+  // A token which is not expanded is written for its own location.
+  if (origin_loc == t->loc) origin_loc += length;
+  if (w->has_line_markers) SyncLine(w, origin_loc);
+  WriteSpan(w, s + length, t->length - length);
+  w->is_line_begin = false;
+}
+
+void EndPreprocessedOutput(void) {
+  FlushPPOutputBuffers(compilation->pp_output);
+}
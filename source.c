@@ -0,0 +1,130 @@
+#include "compilium.h"
+
+// Source locations are 32-bit offsets into a single space shared by every
+// buffer of a compilation. Each buffer added by AddSourceBuffer gets its own
+// range of locations, so a location identifies both the buffer and the
+// position in it. Lines are computed only when they are asked for, from an
+// index of line beginnings which is built on the first lookup.
+
+struct SourceBuffer {
+  const char *path;  // NULL if the buffer is not read from a file
+  const char *begin;
+  unsigned base;  // location of begin
+  int size;
+  int *line_begins;  // offsets of each line, built on demand
+  int num_of_lines;
+};
+
+unsigned AddSourceBuffer(const char *path, const char *begin, int size) {
+  // returns the location of begin.
+  if (compilation->num_of_source_buffers >=
+      compilation->source_buffers_capacity) {
+    compilation->source_buffers_capacity =
+        (compilation->source_buffers_capacity + 1) * 2;
+    compilation->source_buffers =
+        realloc(compilation->source_buffers,
+                sizeof(struct SourceBuffer) *
+                    compilation->source_buffers_capacity);
+    assert(compilation->source_buffers);
+  }
+  // Location 0 is never used. One location after the end of each buffer is
+  // reserved to refer to its end.
+  unsigned base =
+      compilation->next_source_loc ? compilation->next_source_loc : 1;
+  if ((unsigned)size >= 0xFFFFFFFFu - base)
+    Error("Too large inputs to address in 32-bit locations");
+  struct SourceBuffer *b =
+      &compilation->source_buffers[compilation->num_of_source_buffers++];
+  b->path = path;
+  b->begin = begin;
+  b->base = base;
+  b->size = size;
+  b->line_begins = NULL;
+  b->num_of_lines = 0;
+  compilation->next_source_loc = base + size + 1;
+  return base;
+}
+
+static bool IsLocInSourceBuffer(struct SourceBuffer *b, unsigned loc) {
+  return b->base <= loc && loc - b->base <= (unsigned)b->size;
+}
+
+static struct SourceBuffer *FindSourceBuffer(unsigned loc) {
+  assert(compilation->num_of_source_buffers);
+  struct SourceBuffer *buffers = compilation->source_buffers;
+  // Most lookups hit the same buffer as the previous one.
+  struct SourceBuffer *last = &buffers[compilation->last_source_buffer_index];
+  if (IsLocInSourceBuffer(last, loc)) return last;
+  int lo = 0;
+  int hi = compilation->num_of_source_buffers;
+  // find the last buffer whose base <= loc
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    if (buffers[mid].base <= loc) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  assert(IsLocInSourceBuffer(&buffers[lo], loc));
+  compilation->last_source_buffer_index = lo;
+  return &buffers[lo];
+}
+
+const char *GetSourceText(unsigned loc) {
+  struct SourceBuffer *b = FindSourceBuffer(loc);
+  return b->begin + (loc - b->base);
+}
+
+const char *GetSourcePath(unsigned loc) {
+  return FindSourceBuffer(loc)->path;
+}
+
+static void BuildLineIndex(struct SourceBuffer *b) {
+  int capacity = 64;
+  b->line_begins = malloc(sizeof(int) * capacity);
+  if (compilation->mem_report)
+    CountMemReportAlloc(kMemSiteBuildLineIndex, sizeof(int) * capacity);
+  b->line_begins[b->num_of_lines++] = 0;
+  const char *end = b->begin + b->size;
+  const char *p = b->begin;
+  while ((p = memchr(p, '\n', end - p))) {
+    p++;
+    if (b->num_of_lines >= capacity) {
+      if (compilation->mem_report)
+        CountMemReportAlloc(kMemSiteBuildLineIndex, sizeof(int) * capacity);
+      capacity *= 2;
+      b->line_begins = realloc(b->line_begins, sizeof(int) * capacity);
+      assert(b->line_begins);
+    }
+    b->line_begins[b->num_of_lines++] = p - b->begin;
+  }
+}
+
+static int FindLineIndex(struct SourceBuffer *b, unsigned loc) {
+  // returns the 0-origin line which contains loc.
+  if (!b->line_begins) BuildLineIndex(b);
+  int ofs = loc - b->base;
+  int lo = 0;
+  int hi = b->num_of_lines;
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    if (b->line_begins[mid] <= ofs) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+int GetSourceLine(unsigned loc) {
+  // returns the 1-origin line number of loc in its buffer.
+  return FindLineIndex(FindSourceBuffer(loc), loc) + 1;
+}
+
+const char *GetSourceLineBegin(unsigned loc) {
+  struct SourceBuffer *b = FindSourceBuffer(loc);
+  int line_index = FindLineIndex(b, loc);
+  return b->begin + b->line_begins[line_index];
+}
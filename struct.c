@@ -41,15 +41,15 @@ void AddMemberOfStructFromDecl(struct Node *struct_spec, struct Node *decl) {
   struct Node *struct_member = AllocNode(kNodeStructMember);
   struct_member->struct_member_decl = decl;
   struct Node *type = CreateTypeFromDecl(decl);
-  assert(type && type->left);
-  const char *name = CreateTokenStr(type->left);
-  struct Node *dict = struct_spec->struct_member_dict;
-  PushKeyValueToList(dict, name, struct_member);
+  struct Token *ident = GetIdentifierTokenFromTypeAttr(type);
+  assert(ident);
+  PushTokenKeyValueToList(struct_spec->struct_member_dict, ident,
+                          struct_member);
 }
 
 struct Node *FindStructMember(struct Node *struct_type,
-                              struct Node *key_token) {
-  assert(key_token->type == kNodeToken);
+                              struct Token *key_token) {
+  assert(key_token);
   struct_type = GetTypeWithoutAttr(struct_type);
   assert(struct_type && struct_type->type == kTypeStruct);
   return GetNodeByTokenKey(struct_type->type_struct_spec->struct_member_dict,
@@ -58,19 +58,17 @@ struct Node *FindStructMember(struct Node *struct_type,
 
 void ResolveTypesOfMembersOfStruct(struct SymbolEntry *ctx, struct Node *spec) {
   struct Node *dict = spec->struct_member_dict;
-  fprintf(stderr, "Resolving types of struct...\n");
   struct Node *resolved_dict = AllocList();
   for (int i = 0; i < GetSizeOfList(dict); i++) {
     struct Node *kv = GetNodeAt(dict, i);
     struct Node *member_info = kv->value;
     struct Node *type =
         CreateTypeFromDeclInContext(ctx, member_info->struct_member_decl);
-    assert(type && type->left);
+    assert(GetIdentifierTokenFromTypeAttr(type));
     member_info->struct_member_ent_type = GetTypeWithoutAttr(type);
     member_info->struct_member_ent_ofs =
         CalcNextMemberOffset(resolved_dict, type);
-    PrintASTNode(member_info);
-    PushKeyValueToList(resolved_dict, kv->key, kv->value);
+    PushToList(resolved_dict, kv);
   }
   spec->struct_member_dict = resolved_dict;
 }
@@ -3,21 +3,40 @@
 struct SymbolEntry {
   enum SymbolType type;
   struct SymbolEntry *prev;
-  const char *key;
+  int atom;
   struct Node *value;
 };
 
+enum SymbolType GetSymbolType(struct SymbolEntry *e) {
+  return e->type;
+}
+
+struct SymbolEntry *GetPrevSymbol(struct SymbolEntry *e) {
+  return e->prev;
+}
+
+int GetSymbolAtom(struct SymbolEntry *e) {
+  return e->atom;
+}
+
+struct Node *GetSymbolValue(struct SymbolEntry *e) {
+  return e->value;
+}
+
 static void PushSymbol(struct SymbolEntry **prev, struct SymbolEntry *sym) {
   sym->prev = *prev;
   *prev = sym;
 }
 
 static struct SymbolEntry *AllocSymbolEntry(enum SymbolType type,
-                                            const char *key,
+                                            struct Token *key_token,
                                             struct Node *value) {
-  struct SymbolEntry *e = calloc(1, sizeof(struct SymbolEntry));
+  assert(key_token && key_token->atom);
+  struct SymbolEntry *e = AllocFromArena(sizeof(struct SymbolEntry));
+  if (compilation->mem_report)
+    CountMemReportAlloc(kMemSiteAllocSymbolEntry, sizeof(struct SymbolEntry));
   e->type = type;
-  e->key = key;
+  e->atom = key_token->atom;
   e->value = value;
   return e;
 }
@@ -31,7 +50,7 @@ int GetLastLocalVarOffset(struct SymbolEntry *e) {
   return 0;
 }
 
-struct Node *AddLocalVar(struct SymbolEntry **ctx, const char *key,
+struct Node *AddLocalVar(struct SymbolEntry **ctx, struct Token *key_token,
                          struct Node *var_type) {
   assert(ctx);
   int ofs = GetLastLocalVarOffset(*ctx);
@@ -39,64 +58,66 @@ struct Node *AddLocalVar(struct SymbolEntry **ctx, const char *key,
   int align = GetSizeOfType(var_type);
   ofs = (ofs + align - 1) / align * align;
   struct Node *local_var = CreateASTLocalVar(ofs, var_type);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolLocalVar, key, local_var);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(kSymbolLocalVar, key_token, local_var);
   PushSymbol(ctx, e);
   return local_var;
 }
 
-struct Node *FindLocalVar(struct SymbolEntry *e, struct Node *key_token) {
+struct Node *FindLocalVar(struct SymbolEntry *e, struct Token *key_token) {
   for (; e; e = e->prev) {
     if (e->type != kSymbolLocalVar) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
+    if (e->atom != key_token->atom) continue;
     return e->value;
   }
   return NULL;
 }
 
-void AddFuncDef(struct SymbolEntry **ctx, const char *key,
+void AddFuncDef(struct SymbolEntry **ctx, struct Token *key_token,
                 struct Node *func_def) {
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolFuncDef, key, func_def);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(kSymbolFuncDef, key_token, func_def);
   PushSymbol(ctx, e);
 }
 
-struct Node *FindFuncDef(struct SymbolEntry *e, struct Node *key_token) {
+struct Node *FindFuncDef(struct SymbolEntry *e, struct Token *key_token) {
   for (; e; e = e->prev) {
     if (e->type != kSymbolFuncDef) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
+    if (e->atom != key_token->atom) continue;
     return e->value;
   }
   return NULL;
 }
 
-void AddFuncDeclType(struct SymbolEntry **ctx, const char *key,
+void AddFuncDeclType(struct SymbolEntry **ctx, struct Token *key_token,
                      struct Node *func_decl) {
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolFuncDeclType, key, func_decl);
+  struct SymbolEntry *e =
+      AllocSymbolEntry(kSymbolFuncDeclType, key_token, func_decl);
   PushSymbol(ctx, e);
 }
 
-struct Node *FindFuncDeclType(struct SymbolEntry *e, struct Node *key_token) {
+struct Node *FindFuncDeclType(struct SymbolEntry *e, struct Token *key_token) {
   for (; e; e = e->prev) {
     if (e->type != kSymbolFuncDeclType) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
+    if (e->atom != key_token->atom) continue;
     return e->value;
   }
   return NULL;
 }
 
-void AddStructType(struct SymbolEntry **ctx, const char *key,
+void AddStructType(struct SymbolEntry **ctx, struct Token *key_token,
                    struct Node *type) {
   assert(ctx);
-  struct SymbolEntry *e = AllocSymbolEntry(kSymbolStructType, key, type);
+  struct SymbolEntry *e = AllocSymbolEntry(kSymbolStructType, key_token, type);
   PushSymbol(ctx, e);
-  PrintASTNode(type);
 }
 
-struct Node *FindStructType(struct SymbolEntry *e, struct Node *key_token) {
+struct Node *FindStructType(struct SymbolEntry *e, struct Token *key_token) {
   for (; e; e = e->prev) {
     if (e->type != kSymbolStructType) continue;
-    if (!IsEqualTokenWithCStr(key_token, e->key)) continue;
+    if (e->atom != key_token->atom) continue;
     return e->value;
   }
   return NULL;
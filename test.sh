@@ -172,4 +172,18 @@ test_expr_result '1 - -2' 3
 test_stmt_result '; ; return 0;' 0
 test_stmt_result '; return 2; return 0;' 2
 
+# multiple inputs are compiled in parallel, one .S per input
+printf 'int main(){return 3;}' > multi_a.c
+printf 'int main(){return 5;}' > multi_b.c
+./compilium --target-os `uname` -j 2 multi_a.c multi_b.c 2> /dev/null
+for f in a:3 b:5; do
+  gcc -o multi.bin multi_${f%:*}.S
+  actual=0
+  ./multi.bin || actual=$?
+  [ $actual = ${f#*:} ] \
+    && echo "PASS multi_${f%:*}.c returns ${f#*:}" \
+    || { echo "FAIL multi_${f%:*}.c: expected ${f#*:} but got $actual"; exit 1; }
+done
+rm multi_a.c multi_b.c multi_a.S multi_b.S multi.bin
+
 echo "All tests passed."
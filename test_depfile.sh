@@ -0,0 +1,57 @@
+#!/bin/bash -e
+
+# Inputs compiled with --skip-if-unchanged are compiled again only if a file
+# recorded in their dependency file has changed.
+
+printf '#define ANSWER 42\n' > testdep.h
+printf '#include "testdep.h"\nint main() { return ANSWER; }\n' > testdep1.c
+printf 'int main() { return 7; }\n' > testdep2.c
+
+function compile {
+  ./compilium --target-os `uname` $2 --skip-if-unchanged testdep1.c \
+    testdep2.c 2> /dev/null || { echo "FAIL $1: compilation failed"; exit 1; }
+}
+
+compile 'dependency file'
+printf 'testdep1.S: testdep1.c testdep.h\n' > expected.stdout
+head -n 1 testdep1.d > out.stdout
+diff -u expected.stdout out.stdout \
+  && echo "PASS dependency file" \
+  || { echo "FAIL dependency file: diff"; exit 1; }
+
+echo 'broken' > testdep1.S
+echo 'broken' > testdep2.S
+compile 'unchanged inputs'
+[ "`cat testdep1.S testdep2.S`" = "`printf 'broken\nbroken'`" ] \
+  && echo "PASS unchanged inputs are skipped" \
+  || { echo "FAIL unchanged inputs are skipped"; exit 1; }
+
+printf '#define ANSWER 43\n' > testdep.h
+compile 'changed header'
+grep -q 43 testdep1.S && [ "`cat testdep2.S`" = 'broken' ] \
+  && echo "PASS changed header" \
+  || { echo "FAIL changed header"; exit 1; }
+printf '#define ANSWER 5 +\n' > testdep.h
+./compilium --target-os `uname` --skip-if-unchanged testdep1.c testdep2.c \
+  2> /dev/null && { echo "FAIL failed compilation: no error"; exit 1; }
+printf '#define ANSWER 43\n' > testdep.h
+compile 'reverted header'
+grep -q 43 testdep1.S \
+  && echo "PASS output of failed compilation is not skipped" \
+  || { echo "FAIL output of failed compilation is not skipped"; exit 1; }
+echo 'broken' > testdep2.S
+compile 'changed options' '-I .'
+[ "`cat testdep2.S`" != 'broken' ] \
+  && echo "PASS changed options" \
+  || { echo "FAIL changed options"; exit 1; }
+echo 'broken' > testdep2.S
+sed -i.bak 's/^# dependency [0-9a-f]*/# dependency 0x/' testdep2.d
+compile 'corrupt dependency file' '-I .'
+[ "`cat testdep2.S`" != 'broken' ] \
+  && echo "PASS corrupt dependency file" \
+  || { echo "FAIL corrupt dependency file"; exit 1; }
+./compilium --target-os `uname` --skip-if-unchanged testdep2.c \
+  > /dev/null 2>&1 \
+  && { echo "FAIL --skip-if-unchanged with a single input"; exit 1; } \
+  || echo "PASS --skip-if-unchanged with a single input is rejected"
+rm -f testdep.h testdep1.* testdep2.*
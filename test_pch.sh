@@ -0,0 +1,97 @@
+#!/bin/bash -e
+
+# A header is precompiled once and included into a program with --include-pch.
+
+cat > testprelude.h << EOS
+#define ANSWER 42
+#define ADD(a, b) ((a) + (b))
+int putchar(int c);
+struct Point {
+  int x;
+  int y;
+};
+EOS
+
+cat > testinput.c << EOS
+int main() {
+  struct Point p;
+  p.x = 3;
+  p.y = ADD(p.x, 4);
+  putchar('P');
+  return ANSWER + p.y - sizeof(p);
+}
+EOS
+
+./compilium --target-os `uname` --emit-pch testprelude.pch testprelude.h \
+  2> /dev/null || { echo "FAIL --emit-pch"; exit 1; }
+./compilium --target-os `uname` --include-pch testprelude.pch testinput.c \
+  > out.S 2> /dev/null || { echo "FAIL --include-pch"; exit 1; }
+gcc out.S
+actual=0
+./a.out > out.stdout || actual=$?
+printf 'P' > expected.stdout
+diff -u expected.stdout out.stdout \
+  || { echo "FAIL precompiled header: stdout diff"; exit 1; }
+[ $actual = 41 ] \
+  && echo "PASS precompiled header" \
+  || { echo "FAIL precompiled header: expected 41 but got $actual"; exit 1; }
+
+# A truncated file is reported instead of being read out of bounds.
+for size in 8 100; do
+  head -c $size testprelude.pch > testtruncated.pch
+  ./compilium --target-os `uname` --include-pch testtruncated.pch testinput.c \
+    > /dev/null 2> stderr.txt && { echo "FAIL truncated PCH: no error"; exit 1; }
+  grep -q '^Error: testtruncated.pch is' stderr.txt \
+    || { echo "FAIL truncated PCH: no diagnostic"; exit 1; }
+done
+echo "PASS truncated PCH"
+
+# The analyzed AST is written with --emit-ast and compiled again from it.
+./compilium --target-os `uname` --include-pch testprelude.pch \
+  --emit-ast=testinput.ast testinput.c > out.S 2> /dev/null \
+  || { echo "FAIL --emit-ast"; exit 1; }
+# Macro stats are printed only if the input is preprocessed.
+./compilium --target-os `uname` --include-pch testprelude.pch \
+  --load-ast=testinput.ast --macro-stats testinput.c > out_ast.S 2> stderr.txt \
+  || { echo "FAIL --load-ast"; exit 1; }
+diff -u out.S out_ast.S || { echo "FAIL --load-ast: output diff"; exit 1; }
+[ -s stderr.txt ] && { echo "FAIL --load-ast: input was compiled"; exit 1; }
+./compilium --target-os `uname` --load-ast=testinput.ast --dump=symbols \
+  testinput.c > /dev/null 2>&1 \
+  && { echo "FAIL --load-ast: --dump=symbols was not rejected"; exit 1; }
+# A changed input is compiled instead of the AST.
+echo 'int main() { return 7; }' > testinput.c
+./compilium --target-os `uname` --load-ast=testinput.ast testinput.c \
+  > out_ast.S 2> /dev/null || { echo "FAIL --load-ast"; exit 1; }
+gcc out_ast.S
+actual=0
+./a.out || actual=$?
+[ $actual = 7 ] \
+  && echo "PASS AST file" \
+  || { echo "FAIL AST file: expected 7 but got $actual"; exit 1; }
+
+# The AST is not loaded if a header or the target has changed since.
+printf '#define SEVEN 7\n' > testheader.h
+printf '#include "testheader.h"\nint main() { return SEVEN; }\n' > testinput.c
+./compilium --target-os `uname` --emit-ast=testinput.ast testinput.c \
+  > /dev/null 2>&1 || { echo "FAIL --emit-ast"; exit 1; }
+printf '#define SEVEN 8\n' > testheader.h
+./compilium --target-os `uname` --load-ast=testinput.ast testinput.c \
+  > out_ast.S 2> /dev/null || { echo "FAIL --load-ast"; exit 1; }
+gcc out_ast.S
+actual=0
+./a.out || actual=$?
+[ $actual = 8 ] \
+  && echo "PASS AST file with a changed header" \
+  || { echo "FAIL AST file with a changed header: got $actual"; exit 1; }
+./compilium --target-os `uname` --emit-ast=testinput.ast testinput.c \
+  > /dev/null 2>&1 || { echo "FAIL --emit-ast"; exit 1; }
+other_os=Darwin
+[ `uname` = Darwin ] && other_os=Linux
+./compilium --target-os $other_os --load-ast=testinput.ast --macro-stats \
+  testinput.c > /dev/null 2> stderr.txt || { echo "FAIL --load-ast"; exit 1; }
+[ -s stderr.txt ] \
+  && echo "PASS AST file with another target" \
+  || { echo "FAIL AST file with another target: AST was loaded"; exit 1; }
+rm -f testprelude.h testprelude.pch testtruncated.pch testheader.h testinput.c testinput.ast \
+  out.S out_ast.S a.out out.stdout expected.stdout stderr.txt
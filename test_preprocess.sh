@@ -1,12 +1,15 @@
 #!/bin/bash -e
 
+compilium=${COMPILIUM:-./compilium}
+
 function test_stdout {
   input="$1"
   expected_stdout="$2"
   testname="$3"
+  flags="${4--P}"
   printf "$expected_stdout" > expected.stdout
   printf "$input" > testinput.c
-  cat testinput.c | ./compilium -E --target-os `uname` > out.stdout || { \
+  cat testinput.c | $compilium -E $flags --target-os `uname` > out.stdout || { \
     echo "$input" > failcase.txt; \
     echo "Compilation failed."; \
     exit 1; }
@@ -132,3 +135,172 @@ printf("Two %d %d", 1 + 1, 3);
 EOS
 `" \
 'Function-like macros'
+
+test_stdout \
+"`cat << EOS
+#define v 1
+v;
+#undef v
+v;
+#define v 2
+v;
+EOS
+`" \
+"`cat << EOS
+1;
+v;
+2;
+EOS
+`" \
+'#undef and redefinition'
+
+test_stdout \
+"`cat << EOS
+#include <stdbool.h>
+#include <stdbool.h>
+bool b = true;
+EOS
+`" \
+"`cat << EOS
+_Bool b = 1;
+EOS
+`" \
+'#include <...> from the include directory'
+
+test_stdout \
+"`cat << EOS
+#define A 1
+#if A && !defined(B)
+a;
+#elif 1
+#error not taken
+#else
+#error not taken
+#endif
+#ifdef B
+#  if 1
+#error not taken
+#  endif
+/* #endif
+*/
+#else
+b;
+#endif
+#ifndef A
+#error not taken
+#elif A + 1 == 2
+c;
+#endif
+d;
+EOS
+`" \
+"`cat << EOS
+a;
+b;
+c;
+d;
+EOS
+`" \
+'Conditional inclusion'
+
+test_stdout \
+"`cat << EOS
+#if 0
+char *s = "/*";
+char c = '"'; it's /* a comment
+#endif */
+#else
+a;
+#endif
+b;
+EOS
+`" \
+"`cat << EOS
+a;
+b;
+EOS
+`" \
+'Quotes in skipped groups'
+
+test_stdout \
+"`cat << EOS
+#define ADD(a, b) ((a) + (b))
+#define LINE __LINE__
+ADD(ADD(1, 2), f(3, 4));
+LINE;
+EOS
+`" \
+"`cat << EOS
+((((1) + (2))) + (f(3, 4)));
+4;
+EOS
+`" \
+'Function-like macro with nested args and __LINE__'
+
+test_stdout \
+"`cat << EOS
+#define ZERO() 0
+ZERO();
+EOS
+`" \
+"`cat << EOS
+0;
+EOS
+`" \
+'Function-like macro without params'
+
+test_stdout \
+"`cat << EOS
+#define X 1
+
+int a = X;
+#if 0
+#error not taken
+#endif
+int b;
+#if 0
+
+
+
+
+
+
+
+
+#endif
+int c;
+EOS
+`" \
+"`cat << EOS
+# 2 \"<stdin>\"
+
+int a = 1;
+
+
+
+int b;
+# 18 \"<stdin>\"
+int c;
+EOS
+`" \
+'Line markers' ''
+
+test_stdout \
+"`cat << EOS
+#define ONE 1
+#define TWO (ONE + ONE)
+TWO;
+#undef ONE
+#define ONE 2
+TWO;
+#undef ONE
+TWO;
+EOS
+`" \
+"`cat << EOS
+(1 + 1);
+(2 + 2);
+(ONE + ONE);
+EOS
+`" \
+'Expansion of object-like macros follows redefinition'
@@ -1,222 +1,465 @@
 #include "compilium.h"
 
-bool IsToken(struct Node *n) { return n && n->type == kNodeToken; }
+bool IsTokenWithType(struct Token *t, enum TokenType type) {
+  return t && t->type == type;
+}
 
-bool IsTokenWithType(struct Node *n, enum TokenType token_type) {
-  return IsToken(n) && n->token_type == token_type;
+struct Token *AllocToken(void) {
+  if (compilation->mem_report)
+    CountMemReportAlloc(kMemSiteAllocToken, sizeof(struct Token));
+  return AllocFromArena(sizeof(struct Token));
 }
 
-struct Node *AllocToken(const char *src_str, int line, const char *begin,
-                        int length, enum TokenType type) {
-  struct Node *t = AllocNode(kNodeToken);
-  t->begin = begin;
-  t->length = length;
-  t->token_type = type;
-  t->src_str = src_str;
-  t->line = line;
-  return t;
+// Token list
+
+struct TokenList *AllocTokenList(void) {
+  if (compilation->mem_report)
+    CountMemReportAlloc(kMemSiteAllocTokenList, sizeof(struct TokenList));
+  return AllocFromArena(sizeof(struct TokenList));
 }
 
-struct Node *DuplicateToken(struct Node *base_token) {
-  assert(IsToken(base_token));
-  struct Node *t = AllocNode(kNodeToken);
-  memcpy(t, base_token, sizeof(*t));
-  t->next_token = NULL;
-  return t;
+static void ExpandTokenListSizeIfNeeded(struct TokenList *list) {
+  if (list->size < list->capacity) return;
+  int old_capacity = list->capacity;
+  list->capacity = (list->capacity + 1) * 2;
+  if (compilation->mem_report)
+    CountMemReportAlloc(kMemSiteExpandTokenList,
+                        sizeof(struct Token) * (list->capacity - old_capacity));
+  list->tokens =
+      realloc(list->tokens, sizeof(struct Token) * list->capacity);
+  assert(list->tokens);
+  assert(list->size < list->capacity);
 }
 
-struct Node *DuplicateTokenSequence(struct Node *base_head) {
-  struct Node *dup_head = NULL;
-  struct Node **dup_head_holder = &dup_head;
-  while (base_head) {
-    *dup_head_holder = DuplicateToken(base_head);
-    dup_head_holder = &(*dup_head_holder)->next_token;
-    base_head = base_head->next_token;
-  }
-  return dup_head;
+struct Token *PushTokenToList(struct TokenList *list, struct Token *t) {
+  // appends a copy of t and returns the copy.
+  // Pointers into the list are invalidated on the next push.
+  assert(list && t);
+  ExpandTokenListSizeIfNeeded(list);
+  struct Token *copied = &list->tokens[list->size++];
+  *copied = *t;
+  if (compilation->mem_report) CountMemReportToken(t);
+  return copied;
 }
 
-const char *CreateTokenStr(struct Node *t) {
-  assert(IsToken(t));
-  return strndup(t->begin, t->length);
+const char *CreateTokenStr(struct Token *t) {
+  assert(t);
+  if (t->atom) return GetAtomStr(t->atom);
+  return CopyStrToArena(GetTokenBegin(t), t->length);
 }
 
-int IsEqualTokenWithCStr(struct Node *t, const char *s) {
-  return IsToken(t) && strlen(s) == (unsigned)t->length &&
-         strncmp(t->begin, s, t->length) == 0;
+const char *GetTokenBegin(struct Token *t) {
+  return GetSourceText(t->loc);
 }
 
-void PrintTokenSequence(struct Node *t) {
-  if (!t) return;
-  assert(IsToken(t));
-  for (; t; t = t->next_token) {
-    if (t->token_type == kTokenZeroWidthNoBreakSpace) {
-      continue;
-    }
-    fprintf(stderr, "%.*s", t->length, t->begin);
-  }
+int IsEqualTokenWithCStr(struct Token *t, const char *s) {
+  return t && strlen(s) == (unsigned)t->length &&
+         strncmp(GetTokenBegin(t), s, t->length) == 0;
 }
 
-void OutputTokenSequenceAsCSource(struct Node *t) {
-  if (!t) return;
-  assert(IsToken(t));
-  for (; t; t = t->next_token) {
-    if (t->token_type == kTokenZeroWidthNoBreakSpace) {
+bool IsEndOfLineToken(struct Token *t) {
+  // A run of spaces has the newline which ends it, if any, followed by the
+  // indentation of the next line. A comment is an end of line if it is a line
+  // comment, which ends with the newline.
+  if (!IsTokenWithType(t, kTokenDelimiter)) return false;
+  const char *s = GetTokenBegin(t);
+  if (s[0] == '/') return s[t->length - 1] == '\n';
+  return memchr(s, '\n', t->length) != NULL;
+}
+
+static const char *token_type_names[kNumOfTokenTypes] = {
+    [kTokenDelimiter] = "Delimiter",
+    [kTokenZeroWidthNoBreakSpace] = "ZeroWidthNoBreakSpace",
+    [kTokenDecimalNumber] = "DecimalNumber",
+    [kTokenOctalNumber] = "OctalNumber",
+    [kTokenIdent] = "Ident",
+    [kTokenKwChar] = "KwChar",
+    [kTokenKwElse] = "KwElse",
+    [kTokenKwFor] = "KwFor",
+    [kTokenKwIf] = "KwIf",
+    [kTokenKwInt] = "KwInt",
+    [kTokenKwReturn] = "KwReturn",
+    [kTokenKwSizeof] = "KwSizeof",
+    [kTokenKwStruct] = "KwStruct",
+    [kTokenKwVoid] = "KwVoid",
+    [kTokenKwWhile] = "KwWhile",
+    [kTokenCharLiteral] = "CharLiteral",
+    [kTokenStringLiteral] = "StringLiteral",
+    [kTokenPunctuator] = "Punctuator",
+};
+
+const char *GetTokenTypeName(enum TokenType type) {
+  assert(0 <= type && type < kNumOfTokenTypes);
+  return token_type_names[type];
+}
+
+void PrintTokenList(struct TokenList *list, FILE *fp) {
+  if (!list) return;
+  for (int i = 0; i < list->size; i++) {
+    struct Token *t = &list->tokens[i];
+    if (t->type == kTokenZeroWidthNoBreakSpace) {
       continue;
     }
-    fprintf(stdout, "%.*s", t->length, t->begin);
+    fprintf(fp, "%.*s", t->length, GetTokenBegin(t));
   }
 }
 
-void PrintToken(struct Node *t) {
-  fprintf(stderr, "(Token %.*s type=%d)", t->length, t->begin, t->token_type);
+void PrintToken(struct Token *t) {
+  fprintf(stderr, "(Token %.*s type=%d)", t->length, GetTokenBegin(t), t->type);
 }
 
-void PrintTokenBrief(struct Node *t) {
+void PrintTokenBrief(struct Token *t, FILE *fp) {
   assert(t);
-  if (t->token_type == kTokenStringLiteral ||
-      t->token_type == kTokenCharLiteral) {
-    fprintf(stderr, "%.*s", t->length, t->begin);
+  if (t->type == kTokenStringLiteral || t->type == kTokenCharLiteral) {
+    fprintf(fp, "%.*s", t->length, GetTokenBegin(t));
     return;
   }
-  fprintf(stderr, "<%.*s>", t->length, t->begin);
+  fprintf(fp, "<%.*s>", t->length, GetTokenBegin(t));
 }
 
-void PrintTokenStrToFile(struct Node *t, FILE *fp) {
-  fprintf(fp, "%.*s", t->length, t->begin);
+void PrintTokenStrToFile(struct Token *t, FILE *fp) {
+  fprintf(fp, "%.*s", t->length, GetTokenBegin(t));
 }
 
-static bool ShouldRemoveToken(struct Node *t) {
-  return t->token_type == kTokenDelimiter ||
-         t->token_type == kTokenZeroWidthNoBreakSpace;
+static bool ShouldRemoveToken(struct Token *t) {
+  return t->type == kTokenDelimiter || t->type == kTokenZeroWidthNoBreakSpace;
 }
 
 // Token stream
+//
+// Reads tokens of a TokenList by index, or lexes them from the input one at a
+// time. Lexed tokens are kept in a small ring of lookahead tokens, so a token
+// read from the input stays valid only until TOKEN_LOOKAHEAD_SIZE more tokens
+// are read. Tokens inserted at the cursor (e.g. macro expansions) are kept on
+// a stack of slices and read before the rest of the stream, so an insertion
+// never moves the list itself. Inputs pushed by PushLexerInput (e.g. included
+// headers) are lexed before the rest of the current input.
 
-static struct Node **next_token_holder;
+void InitTokenStream(struct TokenList *tokens) {
+  assert(tokens);
+  compilation->token_stream = tokens;
+  compilation->token_stream_pos = 0;
+  compilation->lexer_cursor = NULL;
+  compilation->num_of_token_slices = 0;
+}
 
-void InitTokenStream(struct Node **head_token_holder) {
-  assert(head_token_holder);
-  next_token_holder = head_token_holder;
+void InitTokenStreamFromInput(const char *input, const char *path) {
+  assert(input);
+  int size = strlen(input);
+  compilation->token_stream = NULL;
+  compilation->lexer_cursor = input;
+  compilation->lexer_end = input + size;
+  compilation->lexer_loc = AddSourceBuffer(path, input, size);
+  compilation->has_lookahead = false;
+  compilation->num_of_token_slices = 0;
+  compilation->num_of_lexer_inputs = 0;
 }
 
-static void AdvanceTokenStream(void) {
-  if (!*next_token_holder) return;
-  next_token_holder = &(*next_token_holder)->next_token;
+struct LexerInput {
+  const char *cursor;
+  const char *end;
+  unsigned loc;
+};
+
+#define MAX_LEXER_INPUT_DEPTH 200
+void PushLexerInput(const char *begin, const char *end, unsigned loc) {
+  // lexes [begin, end), which is at loc, before the rest of the input.
+  // This should be called only between tokens, i.e. with no token peeked.
+  assert(!compilation->token_stream && !compilation->has_lookahead);
+  if (compilation->num_of_lexer_inputs >= MAX_LEXER_INPUT_DEPTH)
+    Error("Inputs are nested too deeply");
+  if (compilation->num_of_lexer_inputs >=
+      compilation->lexer_inputs_capacity) {
+    compilation->lexer_inputs_capacity =
+        (compilation->lexer_inputs_capacity + 1) * 2;
+    compilation->lexer_inputs =
+        realloc(compilation->lexer_inputs,
+                sizeof(struct LexerInput) * compilation->lexer_inputs_capacity);
+    assert(compilation->lexer_inputs);
+  }
+  struct LexerInput *saved =
+      &compilation->lexer_inputs[compilation->num_of_lexer_inputs++];
+  saved->cursor = compilation->lexer_cursor;
+  saved->end = compilation->lexer_end;
+  saved->loc = compilation->lexer_loc;
+  compilation->lexer_cursor = begin;
+  compilation->lexer_end = end;
+  compilation->lexer_loc = loc;
 }
 
-struct Node *PeekToken(void) {
-  assert(next_token_holder);
-  return *next_token_holder;
+static bool PopLexerInput(void) {
+  // returns false if there is no input to resume.
+  if (!compilation->num_of_lexer_inputs) return false;
+  struct LexerInput *saved =
+      &compilation->lexer_inputs[--compilation->num_of_lexer_inputs];
+  compilation->lexer_cursor = saved->cursor;
+  compilation->lexer_end = saved->end;
+  compilation->lexer_loc = saved->loc;
+  return true;
 }
 
-struct Node *ReadToken(enum TokenType type) {
-  struct Node *t = *next_token_holder;
-  if (!t || !IsTokenWithType(t, type)) return NULL;
+void SkipInactiveGroup(void) {
+  // skips the input to the directive which ends the current group of #if.
+  // This should be called only at the beginning of a line with no token
+  // peeked.
+  assert(!compilation->token_stream && !compilation->has_lookahead);
+  const char *p =
+      SkipConditionalGroup(compilation->lexer_cursor, compilation->lexer_end);
+  compilation->lexer_loc += p - compilation->lexer_cursor;
+  compilation->lexer_cursor = p;
+}
+
+static struct Token *PeekLexedToken(void) {
+  struct Token *t =
+      &compilation->lookahead_tokens[compilation->lookahead_index];
+  if (compilation->has_lookahead) return t;
+  while (compilation->lexer_cursor >= compilation->lexer_end ||
+         !LexToken(t, &compilation->lexer_cursor, &compilation->lexer_loc)) {
+    if (!PopLexerInput()) return NULL;
+  }
+  compilation->has_lookahead = true;
   return t;
 }
 
-struct Node *ConsumeToken(enum TokenType type) {
-  struct Node *t = *next_token_holder;
+static void AdvanceTokenStream(void) {
+  if (compilation->num_of_token_slices) {
+    struct TokenSlice *s =
+        &compilation->token_slices[compilation->num_of_token_slices - 1];
+    // slices are popped as soon as they are consumed
+    if (++s->begin == s->end) compilation->num_of_token_slices--;
+    return;
+  }
+  if (!compilation->token_stream) {
+    if (!PeekLexedToken()) return;
+    compilation->has_lookahead = false;
+    compilation->lookahead_index =
+        (compilation->lookahead_index + 1) % TOKEN_LOOKAHEAD_SIZE;
+    return;
+  }
+  if (compilation->token_stream_pos < compilation->token_stream->size)
+    compilation->token_stream_pos++;
+}
+
+struct Token *PeekToken(void) {
+  if (compilation->num_of_token_slices)
+    return compilation->token_slices[compilation->num_of_token_slices - 1]
+        .begin;
+  if (!compilation->token_stream) return PeekLexedToken();
+  if (compilation->token_stream_pos >= compilation->token_stream->size)
+    return NULL;
+  return &compilation->token_stream->tokens[compilation->token_stream_pos];
+}
+
+struct Token *ConsumeToken(enum TokenType type) {
+  struct Token *t = PeekToken();
   if (!t || !IsTokenWithType(t, type)) return NULL;
   AdvanceTokenStream();
   return t;
 }
 
-struct Node *ConsumeTokenStr(const char *s) {
-  struct Node *t = *next_token_holder;
+struct Token *ConsumeTokenStr(const char *s) {
+  struct Token *t = PeekToken();
   if (!t || !IsEqualTokenWithCStr(t, s)) return NULL;
   AdvanceTokenStream();
   return t;
 }
 
-struct Node *ExpectTokenStr(const char *s) {
-  struct Node *t = *next_token_holder;
+struct Token *ExpectTokenStr(const char *s) {
+  struct Token *t = PeekToken();
   if (!t) Error("Expect token %s but got EOF", s);
   if (!ConsumeTokenStr(s)) ErrorWithToken(t, "Expected token %s here", s);
   return t;
 }
 
-struct Node *ConsumePunctuator(const char *s) {
-  struct Node *t = *next_token_holder;
-  if (!t || !IsTokenWithType(t, kTokenPunctuator) ||
-      !IsEqualTokenWithCStr(t, s))
-    return NULL;
+_Static_assert(kNumOfPuncts <= 64, "PUNCT_SET should fit in 64 bits");
+
+bool IsPunctToken(struct Token *t, enum PunctuatorType punct) {
+  return t && t->punct == punct;
+}
+
+struct Token *ConsumePunct(enum PunctuatorType punct) {
+  struct Token *t = PeekToken();
+  if (!t || t->punct != punct) return NULL;
   AdvanceTokenStream();
   return t;
 }
 
-struct Node *ExpectPunctuator(const char *s) {
-  struct Node *t = *next_token_holder;
+struct Token *ConsumePunctInSet(unsigned long long punct_set) {
+  // consumes a punctuator p if PUNCT_SET(p) is in punct_set.
+  struct Token *t = PeekToken();
+  if (!t || !t->punct || !(PUNCT_SET(t->punct) & punct_set)) return NULL;
+  AdvanceTokenStream();
+  return t;
+}
+
+struct Token *ExpectPunct(enum PunctuatorType punct) {
+  struct Token *t = PeekToken();
+  const char *s = GetPunctuatorStr(punct);
   if (!t) Error("Expect token %s but got EOF", s);
-  if (!ConsumePunctuator(s)) ErrorWithToken(t, "Expected token %s here", s);
+  if (!ConsumePunct(punct)) ErrorWithToken(t, "Expected token %s here", s);
   return t;
 }
 
-struct Node *NextToken(void) {
-  struct Node *t = *next_token_holder;
+struct Token *NextToken(void) {
+  struct Token *t = PeekToken();
   AdvanceTokenStream();
   return t;
 }
 
-void RemoveCurrentToken(void) {
-  if (!*next_token_holder) return;
-  *next_token_holder = (*next_token_holder)->next_token;
+// Token slices
+//
+// A slice refers to a run of tokens which is inserted as a whole, such as the
+// body of a macro or an argument of it. Tokens of arguments are copied into a
+// pool of chunks, which are never moved so that slices of them stay valid.
+// The pool is reused from its beginning once no slice is left in the stream.
+
+#define TOKEN_CHUNK_SIZE 1024
+
+struct TokenChunk {
+  struct TokenChunk *next;
+  int size;
+  int capacity;
+  struct Token tokens[];
+};
+
+static struct TokenChunk *AllocTokenChunk(int capacity) {
+  size_t size = sizeof(struct TokenChunk) + sizeof(struct Token) * capacity;
+  struct TokenChunk *chunk = malloc(size);
+  assert(chunk);
+  if (compilation->mem_report)
+    CountMemReportAlloc(kMemSiteAllocTokenChunk, size);
+  chunk->next = NULL;
+  chunk->size = 0;
+  chunk->capacity = capacity;
+  return chunk;
 }
 
-void RemoveTokensUpTo(struct Node *end) {
-  while (*next_token_holder && *next_token_holder != end) {
-    RemoveCurrentToken();
+void RecycleTokenPool(void) {
+  // makes the whole pool available again if no slice refers to it.
+  if (compilation->num_of_token_slices) return;
+  for (struct TokenChunk *c = compilation->token_pool; c; c = c->next) {
+    c->size = 0;
   }
+  compilation->current_token_chunk = compilation->token_pool;
 }
 
-void InsertTokens(struct Node *seq_first) {
-  // Insert token sequece (seq) at current cursor pos.
-  if (!IsToken(seq_first)) return;
-  struct Node *seq_last = seq_first;
-  while (seq_last->next_token) seq_last = seq_last->next_token;
-  seq_last->next_token = PeekToken();
-  *next_token_holder = seq_first;
+static struct TokenChunk *GetTokenChunkWithRoom(int size) {
+  // returns the first chunk from the current one which has room for size.
+  struct TokenChunk **c = compilation->current_token_chunk
+                              ? &compilation->current_token_chunk
+                              : &compilation->token_pool;
+  while (*c && (*c)->capacity - (*c)->size < size) c = &(*c)->next;
+  if (!*c) {
+    *c = AllocTokenChunk(size > TOKEN_CHUNK_SIZE ? size * 2 : TOKEN_CHUNK_SIZE);
+  }
+  compilation->current_token_chunk = *c;
+  return *c;
+}
+
+void BeginTokenSlice(struct TokenSlice *s) {
+  // s can be extended by AppendTokenToSlice until another slice is begun.
+  struct TokenChunk *chunk = GetTokenChunkWithRoom(1);
+  s->begin = s->end = &chunk->tokens[chunk->size];
+  s->origin_loc = 0;
+  s->is_expanded = false;
+}
+
+void AppendTokenToSlice(struct TokenSlice *s, struct Token *t) {
+  struct TokenChunk *chunk = compilation->current_token_chunk;
+  assert(chunk && s->end == &chunk->tokens[chunk->size]);
+  if (chunk->size >= chunk->capacity) {
+    // move the slice to a chunk which has room for it to grow
+    int size = s->end - s->begin;
+    chunk->size -= size;
+    chunk = GetTokenChunkWithRoom(size + 1);
+    memcpy(&chunk->tokens[chunk->size], s->begin, sizeof(struct Token) * size);
+    s->begin = &chunk->tokens[chunk->size];
+    s->end = s->begin + size;
+    chunk->size += size;
+  }
+  *s->end++ = *t;
+  chunk->size++;
+}
+
+static void PushTokenSlice(struct Token *begin, struct Token *end,
+                           unsigned origin_loc, bool is_expanded) {
+  if (begin == end) return;
+  if (compilation->num_of_token_slices >=
+      compilation->token_slices_capacity) {
+    compilation->token_slices_capacity =
+        (compilation->token_slices_capacity + 1) * 2;
+    compilation->token_slices =
+        realloc(compilation->token_slices,
+                sizeof(struct TokenSlice) * compilation->token_slices_capacity);
+    assert(compilation->token_slices);
+  }
+  struct TokenSlice *s =
+      &compilation->token_slices[compilation->num_of_token_slices++];
+  s->begin = begin;
+  s->end = end;
+  s->origin_loc = origin_loc;
+  s->is_expanded = is_expanded;
 }
 
-void InsertTokensWithIdentReplace(struct Node *seq, struct Node *rep_list) {
+unsigned GetExpansionOrigin(void) {
+  // returns the location where the expansion which the next token comes from
+  // began, or the location of the next token if it is not expanded.
+  if (compilation->num_of_token_slices)
+    return compilation->token_slices[compilation->num_of_token_slices - 1]
+        .origin_loc;
+  struct Token *t = PeekToken();
+  return t ? t->loc : 0;
+}
+
+void InsertTokens(struct TokenList *seq, unsigned origin_loc) {
   // Insert token sequece (seq) at current cursor pos.
-  // if seq contains token in rep_list, replace it with tokens rep_list[token];
-  // elements of seq will be inserted directly.
-  if (!IsToken(seq)) return;
-  struct Node **next_holder = next_token_holder;
-  while (seq) {
-    struct Node *e;
-    if (!(e = GetNodeByTokenKey(rep_list, seq))) {
-      // no replace
-      struct Node *n = seq;
-      seq = seq->next_token;
-
-      n->next_token = *next_holder;
-      *next_holder = n;
-      next_holder = &(*next_holder)->next_token;
-      continue;
-    }
-    seq = seq->next_token;
-    struct Node *n = DuplicateTokenSequence(e->value);
-    struct Node *n_last = n;
-    while (n_last->next_token) n_last = n_last->next_token;
-    n_last->next_token = *next_holder;
-    *next_holder = n;
-    next_holder = &n_last->next_token;
+  // seq should not be modified while its tokens are in the stream.
+  if (!seq) return;
+  PushTokenSlice(seq->tokens, seq->tokens + seq->size, origin_loc, false);
+}
+
+void InsertExpandedTokens(struct TokenList *seq, unsigned origin_loc) {
+  // Same as InsertTokens, but macros in seq are not expanded again.
+  PushTokenSlice(seq->tokens, seq->tokens + seq->size, origin_loc, true);
+}
+
+bool IsNextTokenExpanded(void) {
+  return compilation->num_of_token_slices &&
+         compilation->token_slices[compilation->num_of_token_slices - 1]
+             .is_expanded;
+}
+
+static int FindMacroParam(struct TokenList *params, struct Token *t) {
+  // returns the index of the param t, or -1 if t is not a param.
+  if (!t->atom) return -1;
+  for (int i = 0; i < params->size; i++) {
+    if (params->tokens[i].atom == t->atom) return i;
   }
+  return -1;
 }
 
-struct Node **RemoveDelimiterTokens(struct Node **head_holder) {
-  InitTokenStream(head_holder);
-  for (;;) {
-    struct Node *t = PeekToken();
-    if (!t) break;
-    if (ShouldRemoveToken(t)) {
-      RemoveCurrentToken();
-      continue;
-    }
-    AdvanceTokenStream();
+void InsertTokensWithArgs(struct TokenList *body, struct TokenList *params,
+                          struct TokenSlice *args, unsigned origin_loc) {
+  // Insert body at current cursor pos, replacing params[i] with args[i].
+  // Runs of body between params are inserted without being copied.
+  struct Token *end = body->tokens + body->size;
+  for (struct Token *t = end - 1; t >= body->tokens; t--) {
+    int param_index = FindMacroParam(params, t);
+    if (param_index < 0) continue;
+    PushTokenSlice(t + 1, end, origin_loc, false);
+    PushTokenSlice(args[param_index].begin, args[param_index].end, origin_loc,
+                   false);
+    end = t;
+  }
+  PushTokenSlice(body->tokens, end, origin_loc, false);
+}
+
+struct TokenList *RemoveDelimiterTokens(struct TokenList *tokens) {
+  int size = 0;
+  for (int i = 0; i < tokens->size; i++) {
+    if (ShouldRemoveToken(&tokens->tokens[i])) continue;
+    tokens->tokens[size++] = tokens->tokens[i];
   }
-  return head_holder;
+  tokens->size = size;
+  return tokens;
 }
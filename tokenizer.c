@@ -1,50 +1,481 @@
 #include "compilium.h"
 
-static struct Node *CreateNextToken(const char *p, const char *src, int *line) {
-  assert(line);
-  if (!*p) return NULL;
-  if (*p == ' ') {
-    return AllocToken(src, *line, p, 1, kTokenDelimiter);
+// Character classes used to scan the bodies of delimiter, number and
+// identifier tokens with a single table lookup per byte. Bytes over 0x7F are
+// not part of any class.
+enum CharClass {
+  kCharSpace = 1,
+  kCharDigit = 2,
+  kCharIdent = 4,
+};
+static const unsigned char char_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x00 - 0x0F
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x10 - 0x1F
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x20 - '/'
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 0, 0, 0, 0, 0, 0,  // '0' - '?'
+    0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,  // '@' - 'O'
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 4,  // 'P' - '_'
+    0, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,  // '`' - 'o'
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0,  // 'p' - 0x7F
+};
+
+static int ScanCharClass(const char *p, int length, enum CharClass char_class) {
+  while (char_classes[(unsigned char)p[length]] & char_class) length++;
+  return length;
+}
+
+// Keywords are classified with a perfect hash on the length and the first and
+// last characters of an identifier, so a lookup is one probe plus at most one
+// memcmp. The table is laid out at compile time; if a new keyword collides
+// with another, the duplicated initializer is reported as a warning.
+#define KEYWORD_TABLE_SIZE 128
+#define KEYWORD_HASH(length, first, last) \
+  (((length) + (first)*10 + (last)*3) & (KEYWORD_TABLE_SIZE - 1))
+#define KEYWORD(s, first, last, type) \
+  [KEYWORD_HASH(sizeof(s) - 1, first, last)] = {s, sizeof(s) - 1, type}
+
+static const struct {
+  const char *str;
+  int length;
+  enum TokenType type;
+} keyword_table[KEYWORD_TABLE_SIZE] = {
+    KEYWORD("char", 'c', 'r', kTokenKwChar),
+    KEYWORD("else", 'e', 'e', kTokenKwElse),
+    KEYWORD("for", 'f', 'r', kTokenKwFor),
+    KEYWORD("if", 'i', 'f', kTokenKwIf),
+    KEYWORD("int", 'i', 't', kTokenKwInt),
+    KEYWORD("return", 'r', 'n', kTokenKwReturn),
+    KEYWORD("sizeof", 's', 'f', kTokenKwSizeof),
+    KEYWORD("struct", 's', 't', kTokenKwStruct),
+    KEYWORD("void", 'v', 'd', kTokenKwVoid),
+    KEYWORD("while", 'w', 'e', kTokenKwWhile),
+};
+
+static enum TokenType ClassifyIdent(const char *p, int length) {
+  assert(length > 0);
+  int h =
+      KEYWORD_HASH(length, (unsigned char)p[0], (unsigned char)p[length - 1]);
+  if (keyword_table[h].length == length &&
+      memcmp(keyword_table[h].str, p, length) == 0)
+    return keyword_table[h].type;
+  return kTokenIdent;
+}
+
+// Punctuators are matched by a DFA over character classes. The lexer follows
+// transitions while they exist and keeps the longest prefix that ended in an
+// accepting state (maximal munch), so ">>=" is one token and "..x" yields ".".
+// Every state except kPunctStateStart and kPunctStateDotDot is accepting.
+enum PunctCharClass {
+  kPunctClassNone,
+  kPunctClassLBracket,
+  kPunctClassRBracket,
+  kPunctClassLParen,
+  kPunctClassRParen,
+  kPunctClassLBrace,
+  kPunctClassRBrace,
+  kPunctClassDot,
+  kPunctClassMinus,
+  kPunctClassPlus,
+  kPunctClassAmp,
+  kPunctClassStar,
+  kPunctClassTilde,
+  kPunctClassExcl,
+  kPunctClassSlash,
+  kPunctClassPercent,
+  kPunctClassLt,
+  kPunctClassGt,
+  kPunctClassAssign,
+  kPunctClassCaret,
+  kPunctClassBar,
+  kPunctClassQuestion,
+  kPunctClassColon,
+  kPunctClassSemicolon,
+  kPunctClassComma,
+  kPunctClassHash,
+  kNumOfPunctCharClasses,
+};
+
+static const unsigned char punct_char_classes[256] = {
+    ['['] = kPunctClassLBracket,
+    [']'] = kPunctClassRBracket,
+    ['('] = kPunctClassLParen,
+    [')'] = kPunctClassRParen,
+    ['{'] = kPunctClassLBrace,
+    ['}'] = kPunctClassRBrace,
+    ['.'] = kPunctClassDot,
+    ['-'] = kPunctClassMinus,
+    ['+'] = kPunctClassPlus,
+    ['&'] = kPunctClassAmp,
+    ['*'] = kPunctClassStar,
+    ['~'] = kPunctClassTilde,
+    ['!'] = kPunctClassExcl,
+    ['/'] = kPunctClassSlash,
+    ['%'] = kPunctClassPercent,
+    ['<'] = kPunctClassLt,
+    ['>'] = kPunctClassGt,
+    ['='] = kPunctClassAssign,
+    ['^'] = kPunctClassCaret,
+    ['|'] = kPunctClassBar,
+    ['?'] = kPunctClassQuestion,
+    [':'] = kPunctClassColon,
+    [';'] = kPunctClassSemicolon,
+    [','] = kPunctClassComma,
+    ['#'] = kPunctClassHash,
+};
+
+enum PunctState {
+  kPunctStateReject,
+  kPunctStateStart,
+  kPunctStateDotDot,
+  kPunctStateLBracket,
+  kPunctStateRBracket,
+  kPunctStateLParen,
+  kPunctStateRParen,
+  kPunctStateLBrace,
+  kPunctStateRBrace,
+  kPunctStateDot,
+  kPunctStateEllipsis,
+  kPunctStateArrow,
+  kPunctStateInc,
+  kPunctStateDec,
+  kPunctStateAmp,
+  kPunctStateStar,
+  kPunctStatePlus,
+  kPunctStateMinus,
+  kPunctStateTilde,
+  kPunctStateExcl,
+  kPunctStateSlash,
+  kPunctStatePercent,
+  kPunctStateLShift,
+  kPunctStateRShift,
+  kPunctStateLt,
+  kPunctStateGt,
+  kPunctStateLtEq,
+  kPunctStateGtEq,
+  kPunctStateEq,
+  kPunctStateNotEq,
+  kPunctStateCaret,
+  kPunctStateBar,
+  kPunctStateAmpAmp,
+  kPunctStateBarBar,
+  kPunctStateQuestion,
+  kPunctStateColon,
+  kPunctStateSemicolon,
+  kPunctStateAssign,
+  kPunctStateStarAssign,
+  kPunctStateSlashAssign,
+  kPunctStatePercentAssign,
+  kPunctStatePlusAssign,
+  kPunctStateMinusAssign,
+  kPunctStateLShiftAssign,
+  kPunctStateRShiftAssign,
+  kPunctStateAmpAssign,
+  kPunctStateCaretAssign,
+  kPunctStateBarAssign,
+  kPunctStateComma,
+  kPunctStateHash,
+  kPunctStateHashHash,
+  kNumOfPunctStates,
+};
+
+static const unsigned char
+    punct_transitions[kNumOfPunctStates][kNumOfPunctCharClasses] = {
+        [kPunctStateStart] =
+            {
+                [kPunctClassLBracket] = kPunctStateLBracket,
+                [kPunctClassRBracket] = kPunctStateRBracket,
+                [kPunctClassLParen] = kPunctStateLParen,
+                [kPunctClassRParen] = kPunctStateRParen,
+                [kPunctClassLBrace] = kPunctStateLBrace,
+                [kPunctClassRBrace] = kPunctStateRBrace,
+                [kPunctClassDot] = kPunctStateDot,
+                [kPunctClassAmp] = kPunctStateAmp,
+                [kPunctClassStar] = kPunctStateStar,
+                [kPunctClassPlus] = kPunctStatePlus,
+                [kPunctClassMinus] = kPunctStateMinus,
+                [kPunctClassTilde] = kPunctStateTilde,
+                [kPunctClassExcl] = kPunctStateExcl,
+                [kPunctClassSlash] = kPunctStateSlash,
+                [kPunctClassPercent] = kPunctStatePercent,
+                [kPunctClassLt] = kPunctStateLt,
+                [kPunctClassGt] = kPunctStateGt,
+                [kPunctClassCaret] = kPunctStateCaret,
+                [kPunctClassBar] = kPunctStateBar,
+                [kPunctClassQuestion] = kPunctStateQuestion,
+                [kPunctClassColon] = kPunctStateColon,
+                [kPunctClassSemicolon] = kPunctStateSemicolon,
+                [kPunctClassAssign] = kPunctStateAssign,
+                [kPunctClassComma] = kPunctStateComma,
+                [kPunctClassHash] = kPunctStateHash,
+            },
+        [kPunctStateDotDot] = {[kPunctClassDot] = kPunctStateEllipsis},
+        [kPunctStateDot] = {[kPunctClassDot] = kPunctStateDotDot},
+        [kPunctStateAmp] = {[kPunctClassAmp] = kPunctStateAmpAmp,
+                            [kPunctClassAssign] = kPunctStateAmpAssign},
+        [kPunctStateStar] = {[kPunctClassAssign] = kPunctStateStarAssign},
+        [kPunctStatePlus] = {[kPunctClassPlus] = kPunctStateInc,
+                             [kPunctClassAssign] = kPunctStatePlusAssign},
+        [kPunctStateMinus] = {[kPunctClassGt] = kPunctStateArrow,
+                              [kPunctClassMinus] = kPunctStateDec,
+                              [kPunctClassAssign] = kPunctStateMinusAssign},
+        [kPunctStateExcl] = {[kPunctClassAssign] = kPunctStateNotEq},
+        [kPunctStateSlash] = {[kPunctClassAssign] = kPunctStateSlashAssign},
+        [kPunctStatePercent] = {[kPunctClassAssign] = kPunctStatePercentAssign},
+        [kPunctStateLShift] = {[kPunctClassAssign] = kPunctStateLShiftAssign},
+        [kPunctStateRShift] = {[kPunctClassAssign] = kPunctStateRShiftAssign},
+        [kPunctStateLt] = {[kPunctClassLt] = kPunctStateLShift,
+                           [kPunctClassAssign] = kPunctStateLtEq},
+        [kPunctStateGt] = {[kPunctClassGt] = kPunctStateRShift,
+                           [kPunctClassAssign] = kPunctStateGtEq},
+        [kPunctStateCaret] = {[kPunctClassAssign] = kPunctStateCaretAssign},
+        [kPunctStateBar] = {[kPunctClassBar] = kPunctStateBarBar,
+                            [kPunctClassAssign] = kPunctStateBarAssign},
+        [kPunctStateAssign] = {[kPunctClassAssign] = kPunctStateEq},
+        [kPunctStateHash] = {[kPunctClassHash] = kPunctStateHashHash},
+};
+
+// kTokenDelimiter (zero) marks the non-accepting states.
+static const enum TokenType punct_state_token_types[kNumOfPunctStates] = {
+    [kPunctStateLBracket] = kTokenPunctuator,
+    [kPunctStateRBracket] = kTokenPunctuator,
+    [kPunctStateLParen] = kTokenPunctuator,
+    [kPunctStateRParen] = kTokenPunctuator,
+    [kPunctStateLBrace] = kTokenPunctuator,
+    [kPunctStateRBrace] = kTokenPunctuator,
+    [kPunctStateDot] = kTokenPunctuator,
+    [kPunctStateEllipsis] = kTokenPunctuator,
+    [kPunctStateArrow] = kTokenPunctuator,
+    [kPunctStateInc] = kTokenPunctuator,
+    [kPunctStateDec] = kTokenPunctuator,
+    [kPunctStateAmp] = kTokenPunctuator,
+    [kPunctStateStar] = kTokenPunctuator,
+    [kPunctStatePlus] = kTokenPunctuator,
+    [kPunctStateMinus] = kTokenPunctuator,
+    [kPunctStateTilde] = kTokenPunctuator,
+    [kPunctStateExcl] = kTokenPunctuator,
+    [kPunctStateSlash] = kTokenPunctuator,
+    [kPunctStatePercent] = kTokenPunctuator,
+    [kPunctStateLShift] = kTokenPunctuator,
+    [kPunctStateRShift] = kTokenPunctuator,
+    [kPunctStateLt] = kTokenPunctuator,
+    [kPunctStateGt] = kTokenPunctuator,
+    [kPunctStateLtEq] = kTokenPunctuator,
+    [kPunctStateGtEq] = kTokenPunctuator,
+    [kPunctStateEq] = kTokenPunctuator,
+    [kPunctStateNotEq] = kTokenPunctuator,
+    [kPunctStateCaret] = kTokenPunctuator,
+    [kPunctStateBar] = kTokenPunctuator,
+    [kPunctStateAmpAmp] = kTokenPunctuator,
+    [kPunctStateBarBar] = kTokenPunctuator,
+    [kPunctStateQuestion] = kTokenPunctuator,
+    [kPunctStateColon] = kTokenPunctuator,
+    [kPunctStateSemicolon] = kTokenPunctuator,
+    [kPunctStateAssign] = kTokenPunctuator,
+    [kPunctStateStarAssign] = kTokenPunctuator,
+    [kPunctStateSlashAssign] = kTokenPunctuator,
+    [kPunctStatePercentAssign] = kTokenPunctuator,
+    [kPunctStatePlusAssign] = kTokenPunctuator,
+    [kPunctStateMinusAssign] = kTokenPunctuator,
+    [kPunctStateLShiftAssign] = kTokenPunctuator,
+    [kPunctStateRShiftAssign] = kTokenPunctuator,
+    [kPunctStateAmpAssign] = kTokenPunctuator,
+    [kPunctStateCaretAssign] = kTokenPunctuator,
+    [kPunctStateBarAssign] = kTokenPunctuator,
+    [kPunctStateComma] = kTokenPunctuator,
+    [kPunctStateHash] = kTokenPunctuator,
+    [kPunctStateHashHash] = kTokenPunctuator,
+};
+
+// Accepting states of punctuators are mapped to their PunctuatorType, which
+// lets the parser match them by integer instead of by spelling.
+static const unsigned char punct_state_puncts[kNumOfPunctStates] = {
+    [kPunctStateLBracket] = kPunctLBracket,
+    [kPunctStateRBracket] = kPunctRBracket,
+    [kPunctStateLParen] = kPunctLParen,
+    [kPunctStateRParen] = kPunctRParen,
+    [kPunctStateLBrace] = kPunctLBrace,
+    [kPunctStateRBrace] = kPunctRBrace,
+    [kPunctStateDot] = kPunctDot,
+    [kPunctStateEllipsis] = kPunctEllipsis,
+    [kPunctStateArrow] = kPunctArrow,
+    [kPunctStateInc] = kPunctInc,
+    [kPunctStateDec] = kPunctDec,
+    [kPunctStateAmp] = kPunctAmp,
+    [kPunctStateStar] = kPunctStar,
+    [kPunctStatePlus] = kPunctPlus,
+    [kPunctStateMinus] = kPunctMinus,
+    [kPunctStateTilde] = kPunctTilde,
+    [kPunctStateExcl] = kPunctExcl,
+    [kPunctStateSlash] = kPunctSlash,
+    [kPunctStatePercent] = kPunctPercent,
+    [kPunctStateLShift] = kPunctLShift,
+    [kPunctStateRShift] = kPunctRShift,
+    [kPunctStateLt] = kPunctLt,
+    [kPunctStateGt] = kPunctGt,
+    [kPunctStateLtEq] = kPunctLtEq,
+    [kPunctStateGtEq] = kPunctGtEq,
+    [kPunctStateEq] = kPunctEq,
+    [kPunctStateNotEq] = kPunctNotEq,
+    [kPunctStateCaret] = kPunctCaret,
+    [kPunctStateBar] = kPunctBar,
+    [kPunctStateAmpAmp] = kPunctAmpAmp,
+    [kPunctStateBarBar] = kPunctBarBar,
+    [kPunctStateQuestion] = kPunctQuestion,
+    [kPunctStateColon] = kPunctColon,
+    [kPunctStateSemicolon] = kPunctSemicolon,
+    [kPunctStateAssign] = kPunctAssign,
+    [kPunctStateStarAssign] = kPunctStarAssign,
+    [kPunctStateSlashAssign] = kPunctSlashAssign,
+    [kPunctStatePercentAssign] = kPunctPercentAssign,
+    [kPunctStatePlusAssign] = kPunctPlusAssign,
+    [kPunctStateMinusAssign] = kPunctMinusAssign,
+    [kPunctStateLShiftAssign] = kPunctLShiftAssign,
+    [kPunctStateRShiftAssign] = kPunctRShiftAssign,
+    [kPunctStateAmpAssign] = kPunctAmpAssign,
+    [kPunctStateCaretAssign] = kPunctCaretAssign,
+    [kPunctStateBarAssign] = kPunctBarAssign,
+    [kPunctStateComma] = kPunctComma,
+    [kPunctStateHash] = kPunctHash,
+    [kPunctStateHashHash] = kPunctHashHash,
+};
+
+static const char *punct_strs[kNumOfPuncts] = {
+    [kPunctLBracket] = "[",
+    [kPunctRBracket] = "]",
+    [kPunctLParen] = "(",
+    [kPunctRParen] = ")",
+    [kPunctLBrace] = "{",
+    [kPunctRBrace] = "}",
+    [kPunctDot] = ".",
+    [kPunctEllipsis] = "...",
+    [kPunctArrow] = "->",
+    [kPunctInc] = "++",
+    [kPunctDec] = "--",
+    [kPunctAmp] = "&",
+    [kPunctStar] = "*",
+    [kPunctPlus] = "+",
+    [kPunctMinus] = "-",
+    [kPunctTilde] = "~",
+    [kPunctExcl] = "!",
+    [kPunctSlash] = "/",
+    [kPunctPercent] = "%",
+    [kPunctLShift] = "<<",
+    [kPunctRShift] = ">>",
+    [kPunctLt] = "<",
+    [kPunctGt] = ">",
+    [kPunctLtEq] = "<=",
+    [kPunctGtEq] = ">=",
+    [kPunctEq] = "==",
+    [kPunctNotEq] = "!=",
+    [kPunctCaret] = "^",
+    [kPunctBar] = "|",
+    [kPunctAmpAmp] = "&&",
+    [kPunctBarBar] = "||",
+    [kPunctQuestion] = "?",
+    [kPunctColon] = ":",
+    [kPunctSemicolon] = ";",
+    [kPunctAssign] = "=",
+    [kPunctStarAssign] = "*=",
+    [kPunctSlashAssign] = "/=",
+    [kPunctPercentAssign] = "%=",
+    [kPunctPlusAssign] = "+=",
+    [kPunctMinusAssign] = "-=",
+    [kPunctLShiftAssign] = "<<=",
+    [kPunctRShiftAssign] = ">>=",
+    [kPunctAmpAssign] = "&=",
+    [kPunctCaretAssign] = "^=",
+    [kPunctBarAssign] = "|=",
+    [kPunctComma] = ",",
+    [kPunctHash] = "#",
+    [kPunctHashHash] = "##",
+};
+
+const char *GetPunctuatorStr(enum PunctuatorType punct) {
+  assert(kPunctNone < punct && punct < kNumOfPuncts);
+  return punct_strs[punct];
+}
+
+static struct Token *InitToken(struct Token *t, unsigned loc, int length,
+                               enum TokenType type) {
+  t->type = type;
+  t->length = length;
+  t->loc = loc;
+  t->atom = 0;
+  t->punct = kPunctNone;
+  return t;
+}
+
+static struct Token *CreatePunctuatorToken(struct Token *t, const char *p,
+                                           unsigned loc) {
+  int state = kPunctStateStart;
+  int accepted_state = kPunctStateReject;
+  int length = 0;
+  int accepted_length = 0;
+  for (;;) {
+    int char_class = punct_char_classes[(unsigned char)p[length]];
+    state = punct_transitions[state][char_class];
+    if (!state) break;
+    length++;
+    if (punct_state_token_types[state] == kTokenDelimiter) continue;
+    accepted_state = state;
+    accepted_length = length;
   }
-  if (*p == '\n') {
-    (*line)++;
-    return AllocToken(src, *line, p, 1, kTokenDelimiter);
+  if (!accepted_length) return NULL;
+  InitToken(t, loc, accepted_length, punct_state_token_types[accepted_state]);
+  t->punct = punct_state_puncts[accepted_state];
+  return t;
+}
+
+static int ScanComment(const char *p) {
+  // returns the length of the comment at p, including the newline after a
+  // line comment. Comments are scanned for their ends without being lexed.
+  const char *end;
+  if (p[1] == '*') {
+    end = p + 2;
+    while ((end = strchr(end, '*')) && end[1] != '/') end++;
+    if (!end) Error("Unterminated comment");
+    return end + 2 - p;
+  }
+  end = p + 2;
+  // A backslash at the end of a line continues the comment.
+  while ((end = strchr(end, '\n')) && end[-1] == '\\') end++;
+  return end ? end + 1 - p : (int)strlen(p);
+}
+
+static struct Token *CreateNextToken(struct Token *t, const char *p,
+                                     unsigned loc) {
+  // fills t with the token starting at p, which is at loc.
+  // returns NULL at the end of input.
+  if (!*p) return NULL;
+  if (*p == ' ' || *p == '\n') {
+    // A run of spaces, the newline that ends it and the indentation of the
+    // next line become one token, so a token has at most one newline.
+    int length = ScanCharClass(p, 0, kCharSpace);
+    if (p[length] == '\n') length = ScanCharClass(p, length + 1, kCharSpace);
+    return InitToken(t, loc, length, kTokenDelimiter);
   }
   if (p[0] == '\\' && p[1] == '\n') {
-    (*line)++;
-    return AllocToken(src, *line, p, 2, kTokenZeroWidthNoBreakSpace);
+    return InitToken(t, loc, 2, kTokenZeroWidthNoBreakSpace);
+  }
+  if (p[0] == '/' && (p[1] == '/' || p[1] == '*')) {
+    // A comment is a delimiter, which is an end of line if it is a line
+    // comment.
+    return InitToken(t, loc, ScanComment(p), kTokenDelimiter);
   }
   if ('1' <= *p && *p <= '9') {
-    int length = 0;
-    while ('0' <= p[length] && p[length] <= '9') {
-      length++;
-    }
-    return AllocToken(src, *line, p, length, kTokenDecimalNumber);
+    int length = ScanCharClass(p, 0, kCharDigit);
+    return InitToken(t, loc, length, kTokenDecimalNumber);
   } else if ('0' == *p) {
     int length = 0;
     while ('0' <= p[length] && p[length] <= '7') {
       length++;
     }
-    return AllocToken(src, *line, p, length, kTokenOctalNumber);
+    return InitToken(t, loc, length, kTokenOctalNumber);
   } else if (('A' <= *p && *p <= 'Z') || ('a' <= *p && *p <= 'z') ||
              *p == '_') {
-    int length = 0;
-    while (('A' <= p[length] && p[length] <= 'Z') ||
-           ('a' <= p[length] && p[length] <= 'z') || p[length] == '_' ||
-           ('0' <= p[length] && p[length] <= '9')) {
-      length++;
-    }
-    struct Node *t = AllocToken(src, *line, p, length, kTokenIdent);
-    if (IsEqualTokenWithCStr(t, "char")) t->token_type = kTokenKwChar;
-    if (IsEqualTokenWithCStr(t, "else")) t->token_type = kTokenKwElse;
-    if (IsEqualTokenWithCStr(t, "for")) t->token_type = kTokenKwFor;
-    if (IsEqualTokenWithCStr(t, "if")) t->token_type = kTokenKwIf;
-    if (IsEqualTokenWithCStr(t, "int")) t->token_type = kTokenKwInt;
-    if (IsEqualTokenWithCStr(t, "return")) t->token_type = kTokenKwReturn;
-    if (IsEqualTokenWithCStr(t, "sizeof")) t->token_type = kTokenKwSizeof;
-    if (IsEqualTokenWithCStr(t, "struct")) t->token_type = kTokenKwStruct;
-    if (IsEqualTokenWithCStr(t, "void")) t->token_type = kTokenKwVoid;
-    if (IsEqualTokenWithCStr(t, "while")) t->token_type = kTokenKwWhile;
+    int length = ScanCharClass(p, 0, kCharIdent);
+    InitToken(t, loc, length, ClassifyIdent(p, length));
+    t->atom = InternAtom(p, length);
     return t;
   } else if ('\'' == *p) {
     int length = 1;
@@ -58,7 +489,7 @@ static struct Node *CreateNextToken(const char *p, const char *src, int *line) {
       Error("Expected end of char literal (')");
     }
     length++;
-    return AllocToken(src, *line, p, length, kTokenCharLiteral);
+    return InitToken(t, loc, length, kTokenCharLiteral);
   } else if ('"' == *p) {
     int length = 1;
     while (p[length] && p[length] != '"') {
@@ -71,138 +502,211 @@ static struct Node *CreateNextToken(const char *p, const char *src, int *line) {
       Error("Expected end of string literal (\")");
     }
     length++;
-    return AllocToken(src, *line, p, length, kTokenStringLiteral);
-  } else if ('#' == *p) {
-    if (p[1] == '#') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('&' == *p) {
-    if (p[1] == '&') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
+    return InitToken(t, loc, length, kTokenStringLiteral);
+  }
+  if (CreatePunctuatorToken(t, p, loc)) return t;
+  Error("Tokenizer: Unexpected char %c", *p);
+}
+
+struct Token *CreateToken(const char *input) {
+  struct Token *t = AllocToken();
+  if (!CreateNextToken(t, input, AddSourceBuffer(NULL, input, strlen(input))))
+    return NULL;
+  if (compilation->mem_report) CountMemReportToken(t);
+  return t;
+}
+
+struct Token *LexToken(struct Token *t, const char **p, unsigned *loc) {
+  // reads the token at *p into t and advances *p and *loc past it.
+  // returns NULL at the end of input.
+  if (!CreateNextToken(t, *p, *loc)) return NULL;
+  *p += t->length;
+  *loc += t->length;
+  return t;
+}
+
+// Skipping groups of #if
+//
+// Lines in a group which is not taken are never tokenized. They are scanned
+// for a # at the beginning of a line with memchr, skipping block comments.
+// String and character literals are skipped when looking for comments, so that
+// "/*" does not begin one.
+
+static const char *SkipSpacesInLine(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  return p;
+}
+
+static const char *FindCommentInLine(const char *p, const char *nl) {
+  // returns the / which begins a comment in [p, nl), or NULL if there is none.
+  // A quote which is not closed in the line is not taken as a literal, e.g.
+  // the apostrophe in text like it's.
+  for (; p < nl; p++) {
+    if (*p == '"' || *p == '\'') {
+      const char *q = p + 1;
+      while (q < nl && *q != *p) q += (*q == '\\' && q + 1 < nl) ? 2 : 1;
+      if (q < nl) p = q;
+      continue;
     }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('|' == *p) {
-    if (p[1] == '|') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
+    if (*p == '/' && p + 1 < nl && (p[1] == '/' || p[1] == '*')) return p;
+  }
+  return NULL;
+}
+
+static const char *SkipToNextLineInGroup(const char *p, const char *end) {
+  // returns the beginning of the next line. Comments are skipped so that
+  // the returned line does not begin inside of a comment.
+  for (;;) {
+    const char *nl = memchr(p, '\n', end - p);
+    if (!nl) return end;
+    const char *c = FindCommentInLine(p, nl);
+    if (c && c[1] == '*') {
+      // skip to the end of the block comment, which may be on another line
+      p = c + 2;
+      while ((p = memchr(p, '*', end - p)) && (p + 1 >= end || p[1] != '/'))
+        p++;
+      if (!p) return end;
+      p += 2;
+      continue;
     }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('<' == *p) {
-    if (p[1] == '<') {
-      if (p[2] == '=') {
-        return AllocToken(src, *line, p, 3, kTokenPunctuator);
-      }
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    } else if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
+    // A backslash at the end of a line continues the line.
+    if (nl > p && nl[-1] == '\\') {
+      p = nl + 1;
+      continue;
     }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('>' == *p) {
-    if (p[1] == '>') {
-      if (p[2] == '=') {
-        return AllocToken(src, *line, p, 3, kTokenPunctuator);
+    return nl + 1;
+  }
+}
+
+static bool IsDirectiveName(const char *p, int length, const char *name) {
+  return (int)strlen(name) == length && strncmp(p, name, length) == 0;
+}
+
+const char *SkipConditionalGroup(const char *p, const char *end) {
+  // p should be at the beginning of a line. returns the # of the #elif, #else
+  // or #endif which ends the group at p, or end if there is none.
+  int depth = 0;
+  while (p < end) {
+    const char *hash = SkipSpacesInLine(p, end);
+    if (hash < end && *hash == '#') {
+      const char *name = SkipSpacesInLine(hash + 1, end);
+      int length = name < end ? ScanCharClass(name, 0, kCharIdent) : 0;
+      if (name + length > end) length = end - name;
+      if (IsDirectiveName(name, length, "if") ||
+          IsDirectiveName(name, length, "ifdef") ||
+          IsDirectiveName(name, length, "ifndef")) {
+        depth++;
+      } else if (IsDirectiveName(name, length, "endif")) {
+        if (!depth--) return hash;
+      } else if (!depth && (IsDirectiveName(name, length, "elif") ||
+                            IsDirectiveName(name, length, "else"))) {
+        return hash;
       }
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    } else if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('=' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('!' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('^' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('+' == *p) {
-    if (p[1] == '+') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('-' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    if (p[1] == '>') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
     }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('*' == *p) {
-    if (p[1] == '/') {
-      return AllocToken(src, *line, p, 2, kTokenBlockCommentEnd);
-    }
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('/' == *p) {
-    if (p[1] == '/') {
-      return AllocToken(src, *line, p, 2, kTokenLineComment);
-    }
-    if (p[1] == '*') {
-      return AllocToken(src, *line, p, 2, kTokenBlockCommentBegin);
-    }
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('%' == *p) {
-    if (p[1] == '=') {
-      return AllocToken(src, *line, p, 2, kTokenPunctuator);
-    }
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('~' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('?' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (':' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (',' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (';' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('{' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('}' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('(' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (')' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('.' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if ('[' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
-  } else if (']' == *p) {
-    return AllocToken(src, *line, p, 1, kTokenPunctuator);
+    p = SkipToNextLineInGroup(hash, end);
   }
-  Error("Tokenizer: Unexpected char %c", *p);
+  return end;
 }
 
-struct Node *CreateToken(const char *input) {
-  int line = 1;
-  return CreateNextToken(input, input, &line);
+struct TokenList *Tokenize(const char *input) {
+  struct TokenList *tokens = AllocTokenList();
+  const char *p = input;
+  unsigned loc = AddSourceBuffer(NULL, input, strlen(input));
+  struct Token t;
+  while (LexToken(&t, &p, &loc)) {
+    PushTokenToList(tokens, &t);
+  }
+  return tokens;
 }
 
-struct Node *Tokenize(const char *input) {
-  // returns head of tokens.
-  struct Node *token_head = NULL;
-  struct Node **last_next_token = &token_head;
-  const char *p = input;
-  struct Node *t;
-  int line = 1;
-  while ((t = CreateNextToken(p, input, &line))) {
-    *last_next_token = t;
-    last_next_token = &t->next_token;
-    p = t->begin + t->length;
+void TestTokenizer() {
+  fprintf(stderr, "Testing Tokenizer...");
+
+  for (int i = 0; i < KEYWORD_TABLE_SIZE; i++) {
+    if (!keyword_table[i].str) continue;
+    struct Token *t = CreateToken(keyword_table[i].str);
+    assert(t->type == keyword_table[i].type);
+    assert(t->length == keyword_table[i].length);
+  }
+  assert(CreateToken("int")->type == kTokenKwInt);
+  assert(CreateToken("while")->type == kTokenKwWhile);
+  assert(CreateToken("in")->type == kTokenIdent);
+  assert(CreateToken("iff")->type == kTokenIdent);
+  assert(CreateToken("chat")->type == kTokenIdent);
+  assert(CreateToken("Int")->type == kTokenIdent);
+  assert(CreateToken("structs")->type == kTokenIdent);
+  assert(CreateToken("_")->type == kTokenIdent);
+
+  assert(CreateToken("foo")->atom);
+  assert(CreateToken("foo")->atom == CreateToken("foo")->atom);
+  assert(CreateToken("foo")->atom != CreateToken("fo")->atom);
+  assert(CreateToken("foo")->atom != CreateToken("foo_")->atom);
+  assert(CreateToken("int")->atom == CreateToken("int")->atom);
+  assert(strcmp(GetAtomStr(CreateToken("foo+")->atom), "foo") == 0);
+  assert(!CreateToken("+")->atom);
+  assert(!CreateToken("1")->atom);
+
+  assert(CreateToken(">>=")->length == 3);
+  assert(CreateToken(">>1")->length == 2);
+  assert(CreateToken("->")->length == 2);
+  assert(CreateToken("-1")->length == 1);
+  assert(CreateToken("...")->length == 3);
+  assert(CreateToken("..x")->length == 1);
+  assert(CreateToken("##")->length == 2);
+  assert(CreateToken("+++")->length == 2);
+  assert(CreateToken("&&=")->length == 2);
+  assert(CreateToken("*/")->punct == kPunctStar);
+  assert(CreateToken("/* a\n*/ b")->type == kTokenDelimiter);
+  assert(CreateToken("/* a\n*/ b")->length == 7);
+  assert(CreateToken("/* a **/")->length == 8);
+  assert(!IsEndOfLineToken(CreateToken("/* a\n*/")));
+  assert(CreateToken("// a\n b")->length == 5);
+  assert(CreateToken("// a\\\n b\n c")->length == 9);
+  assert(CreateToken("// a")->length == 4);
+  assert(IsEndOfLineToken(CreateToken("// a\n")));
+  assert(CreateToken("/=")->type == kTokenPunctuator);
+  for (int p = kPunctNone + 1; p < kNumOfPuncts; p++) {
+    struct Token *t = CreateToken(GetPunctuatorStr(p));
+    assert(t->type == kTokenPunctuator && (int)t->punct == p);
+    assert(IsEqualTokenWithCStr(t, GetPunctuatorStr(p)));
+  }
+  assert(CreateToken("//")->punct == kPunctNone);
+  assert(CreateToken("//")->type == kTokenDelimiter);
+  assert(CreateToken("x")->punct == kPunctNone);
+
+  assert(CreateToken("    x")->length == 4);
+  assert(CreateToken("  \n  x")->length == 5);
+  assert(CreateToken("\n\n")->length == 1);
+  assert(CreateToken(" \n \n")->length == 3);
+  assert(IsEndOfLineToken(CreateToken("  \n")));
+  assert(IsEndOfLineToken(CreateToken("  \n  x")));
+  assert(!IsEndOfLineToken(CreateToken("  x")));
+  assert(CreateToken("a_1+")->length == 3);
+  assert(CreateToken("123a")->length == 3);
+
+  struct TokenList *lines = Tokenize("a\nb\n  c");
+  assert(GetSourceLine(lines->tokens[0].loc) == 1);
+  assert(GetSourceLine(lines->tokens[2].loc) == 2);
+  assert(GetSourceLine(lines->tokens[4].loc) == 3);
+  assert(*GetSourceLineBegin(lines->tokens[4].loc) == ' ');
+  assert(GetSourceLine(CreateToken("x")->loc) == 1);
+
+  fprintf(stderr, "PASS\n");
+  exit(EXIT_SUCCESS);
+}
+
+#define BENCHMARK_ITERATIONS 5
+void BenchmarkTokenizer(const char *input) {
+  long input_size = strlen(input);
+  long num_of_tokens = 0;
+  clock_t begin = clock();
+  for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    num_of_tokens += Tokenize(input)->size;
   }
-  return token_head;
+  double sec = (double)(clock() - begin) / CLOCKS_PER_SEC;
+  fprintf(stderr, "Tokenizer: %ld bytes, %ld tokens x %d in %.3f sec\n",
+          input_size, num_of_tokens / BENCHMARK_ITERATIONS,
+          BENCHMARK_ITERATIONS, sec);
+  fprintf(stderr, "Tokenizer: %.2f MB/s\n",
+          input_size * BENCHMARK_ITERATIONS / sec / 1e6);
 }
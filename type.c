@@ -28,9 +28,9 @@ struct Node *GetTypeWithoutAttr(struct Node *t) {
   return GetTypeWithoutAttr(t->right);
 }
 
-struct Node *GetIdentifierTokenFromTypeAttr(struct Node *t) {
+struct Token *GetIdentifierTokenFromTypeAttr(struct Node *t) {
   if (!t || t->type != kTypeAttrIdent) return NULL;
-  return t->left;
+  return t->op;
 }
 
 struct Node *GetRValueType(struct Node *t) {
@@ -50,7 +50,7 @@ int IsAssignable(struct Node *dst, struct Node *src) {
 int EvalExprAsInt(struct Node *n) {
   assert(n);
   if (IsTokenWithType(n->op, kTokenDecimalNumber)) {
-    return strtol(n->op->begin, NULL, 0);
+    return strtol(GetTokenBegin(n->op), NULL, 0);
   }
   assert(false);
 }
@@ -59,8 +59,8 @@ int GetSizeOfType(struct Node *t) {
   t = GetTypeWithoutAttr(t);
   assert(t);
   if (t->type == kTypeBase) {
-    assert(IsToken(t->op));
-    switch (t->op->token_type) {
+    assert(t->op);
+    switch (t->op->type) {
       case kTokenKwInt:
         return 4;
       case kTokenKwChar:
@@ -84,8 +84,8 @@ int GetAlignOfType(struct Node *t) {
   t = GetTypeWithoutAttr(t);
   assert(t);
   if (t->type == kTypeBase) {
-    assert(IsToken(t->op));
-    switch (t->op->token_type) {
+    assert(t->op);
+    switch (t->op->type) {
       case kTokenKwInt:
         return 4;
       case kTokenKwChar:
@@ -118,7 +118,7 @@ struct Node *CreateTypeFromDecltor(struct Node *decltor, struct Node *type) {
   for (struct Node *dd = decltor->right; dd; dd = dd->left) {
     assert(dd->type == kASTDirectDecltor);
     if (dd->left) {
-      if (IsEqualTokenWithCStr(dd->op, "(")) {
+      if (IsPunctToken(dd->op, kPunctLParen)) {
         struct Node *arg_type_list = AllocList();
         for (int i = 0; i < GetSizeOfList(dd->right); i++) {
           PushToList(arg_type_list,
@@ -127,15 +127,15 @@ struct Node *CreateTypeFromDecltor(struct Node *decltor, struct Node *type) {
         type = CreateTypeFunction(type, arg_type_list);
         continue;
       }
-      if (IsEqualTokenWithCStr(dd->op, "[")) {
+      if (IsPunctToken(dd->op, kPunctLBracket)) {
         type = CreateTypeArray(type, dd->right);
         continue;
       }
     }
     assert(!dd->left);
-    if (IsEqualTokenWithCStr(dd->op, "(")) {
-      assert(dd->value && dd->value->type == kASTDecltor);
-      type = CreateTypeFromDecltor(dd->value, type);
+    if (IsPunctToken(dd->op, kPunctLParen)) {
+      assert(dd->decltor && dd->decltor->type == kASTDecltor);
+      type = CreateTypeFromDecltor(dd->decltor, type);
       continue;
     }
     assert(IsTokenWithType(dd->op, kTokenIdent));
@@ -147,7 +147,7 @@ struct Node *CreateTypeFromDecltor(struct Node *decltor, struct Node *type) {
 static struct Node *CreateBaseTypeFromDeclSpec(struct SymbolEntry *ctx,
                                                struct Node *decl_spec) {
   assert(decl_spec);
-  if (IsToken(decl_spec)) return CreateTypeBase(decl_spec);
+  if (decl_spec->type == kTypeBase) return CreateTypeBase(decl_spec->op);
   if (decl_spec->type == kASTStructSpec) {
     if (!decl_spec->struct_member_dict) {
       assert(decl_spec->tag);
@@ -173,21 +173,19 @@ struct Node *CreateType(struct Node *decl_spec, struct Node *decltor) {
 
 struct Node *CreateTypeFromDecl(struct Node *decl) {
   assert(decl && decl->type == kASTDecl);
-  return CreateType(decl->op, decl->right);
+  return CreateType(decl->left, decl->right);
 }
 
 struct Node *CreateTypeFromDeclInContext(struct SymbolEntry *ctx,
                                          struct Node *decl) {
   assert(decl && decl->type == kASTDecl);
-  return CreateTypeInContext(ctx, decl->op, decl->right);
+  return CreateTypeInContext(ctx, decl->left, decl->right);
 }
 
-struct Node *Tokenize(const char *input);
 struct Node *ParseDecl(void);
 static struct Node *CreateTypeFromInput(const char *s) {
   fprintf(stderr, "CreateTypeFromInput: %s\n", s);
-  struct Node *tokens = Tokenize(s);
-  InitParser(&tokens);
+  InitParser(Tokenize(s));
   return CreateTypeFromDecl(ParseDecl());
 }
 _Noreturn void TestType() {